@@ -1,16 +1,27 @@
 #include "mpoi.h"
+#include "mpoi_precision.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
 #include <memory>
 
 mpoi::mpoi ()
     : _next_key (0)
-    , _src ("") {
+    , _src ("")
+    , _clock (0)
+    , _has_fp16 (false)
+    , _verbose (true) {
     _setup_opencl();
 }
 
 mpoi::mpoi (const std::string& src)
     : _next_key (0)
-    , _src (src) {
+    , _src (src)
+    , _clock (0)
+    , _has_fp16 (false)
+    , _verbose (true) {
     _setup_opencl();
     build_program (_src);
 }
@@ -21,17 +32,41 @@ mpoi::mpoi (const mpoi& obj)
     , _cmd_queue (obj._cmd_queue)
     , _program (obj._program)
     , _kernels (obj._kernels)
+    , _programs (obj._programs)
+    , _source_kernels (obj._source_kernels)
     , _buffers (obj._buffers)
+    , _batch_tables (obj._batch_tables)
+    , _typed_buffers (obj._typed_buffers)
     , _next_key (obj._next_key)
-    , _src (obj._src) {}
+    , _src (obj._src)
+    , _bindings (obj._bindings)
+    , _clock (obj._clock)
+    , _stats (obj._stats)
+    , _has_fp16 (obj._has_fp16)
+    , _verbose (obj._verbose) {}
 
 mpoi::~mpoi () { _cleanup_opencl(); }
 
 mpoi&
 mpoi::operator= (const mpoi& obj) {
+    if (this == &obj) return *this;
+
+    // Kernels, programs and buffers belong to the previous context.
+    _cleanup_opencl();
+
     _next_key = 0;
     _src      = obj._src;
 
+    _kernels.clear();
+    _programs.clear();
+    _source_kernels.clear();
+    _buffers.clear();
+    _batch_tables.clear();
+    _typed_buffers.clear();
+    _bindings.clear();
+    _clock = 0;
+    _stats = residency_stats();
+
     _setup_opencl();
 
     if (_src != "") {
@@ -103,6 +138,18 @@ mpoi::_setup_opencl () {
         exit (1);
     }
 
+    cl_ulong global_mem_size = 0;
+    err                      = clGetDeviceInfo (
+        _device_id, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof (cl_ulong), &global_mem_size, NULL
+    );
+    _stats.budget = static_cast<std::size_t> (global_mem_size);
+
+    std::size_t extensions_size = 0;
+    clGetDeviceInfo (_device_id, CL_DEVICE_EXTENSIONS, 0, NULL, &extensions_size);
+    std::string extensions (extensions_size, '\0');
+    clGetDeviceInfo (_device_id, CL_DEVICE_EXTENSIONS, extensions_size, extensions.data(), NULL);
+    _has_fp16 = extensions.find ("cl_khr_fp16") != std::string::npos;
+
     _context = clCreateContext (NULL, 1, &_device_id, NULL, NULL, &err);
     if (err != CL_SUCCESS) {
         std::cerr << "Error in creating a context.\n";
@@ -120,16 +167,166 @@ void
 mpoi::_cleanup_opencl () {
     clFlush (_cmd_queue);
     clFinish (_cmd_queue);
+    for (auto& [id, buffer] : _buffers) {
+        if (buffer.mem != NULL) clReleaseMemObject (buffer.mem);
+    }
     for (std::size_t i = 0; i != _kernels.size(); i++) {
         clReleaseKernel (_kernels[i]);
     }
-    if (!_program) {
+    if (_program) {
         clReleaseProgram (_program);
     }
+    for (std::size_t i = 0; i != _programs.size(); i++) {
+        clReleaseProgram (_programs[i]);
+    }
     clReleaseCommandQueue (_cmd_queue);
     clReleaseContext (_context);
 }
 
+// OpenCL helper functions prepended to every program built by mpoi.
+// A batch packs many variable-sized problems back to back; `offsets` holds
+// `count + 1` entries where problem p occupies [offsets[p], offsets[p + 1]).
+static const char* _cl_prelude = R"CL(
+inline uint mpoi_batch_problem (__global const uint* offsets, const uint count, const uint gid) {
+    uint lo = 0;
+    uint hi = count;
+    while (hi - lo > 1) {
+        const uint mid = (lo + hi) / 2;
+        if (offsets[mid] <= gid) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+inline uint mpoi_batch_local_id (__global const uint* offsets, const uint problem, const uint gid) {
+    return gid - offsets[problem];
+}
+
+inline uint mpoi_batch_problem_size (__global const uint* offsets, const uint problem) {
+    return offsets[problem + 1] - offsets[problem];
+}
+
+inline uint mpoi_batch_total_size (__global const uint* offsets, const uint count) {
+    return offsets[count];
+}
+)CL";
+
+// Conversion kernels of typed buffers.  `mpoi_widen` turns the compact
+// representation into floats, `mpoi_narrow` does the reverse, rounding to
+// nearest even like mpoi_precision on the host.  Both take (in, out, scale,
+// offset, count); `mpoi_narrow` takes the inverse of the scale.
+static const char* _cl_conversion_header = R"CL(
+#pragma OPENCL FP_CONTRACT OFF
+)CL";
+
+static const char* _cl_conversion_float16 = R"CL(
+#pragma OPENCL EXTENSION cl_khr_fp16 : enable
+
+__kernel void mpoi_widen (__global const half* in, __global float* out,
+                          const float scale, const float offset, const uint n) {
+    const uint gid = get_global_id(0);
+    if (gid < n) out[gid] = convert_float(in[gid]);
+}
+
+__kernel void mpoi_narrow (__global const float* in, __global half* out,
+                           const float inv_scale, const float offset, const uint n) {
+    const uint gid = get_global_id(0);
+    if (gid < n) out[gid] = convert_half_rte(in[gid]);
+}
+)CL";
+
+// Same bit manipulations as the scalar path of mpoi_precision.
+static const char* _cl_conversion_float16_emulated = R"CL(
+__kernel void mpoi_widen (__global const ushort* in, __global float* out,
+                          const float scale, const float offset, const uint n) {
+    const uint gid = get_global_id(0);
+    if (gid >= n) return;
+
+    const uint h   = in[gid];
+    uint       f   = (h & 0x7fffu) << 13;
+    const uint exp = f & (0x7c00u << 13);
+    f += (127u - 15u) << 23;
+    if (exp == (0x7c00u << 13)) {
+        f += (128u - 16u) << 23;
+    } else if (exp == 0) {
+        f += 1u << 23;
+        f = as_uint(as_float(f) - as_float(113u << 23));
+    }
+    out[gid] = as_float(f | ((h & 0x8000u) << 16));
+}
+
+__kernel void mpoi_narrow (__global const float* in, __global ushort* out,
+                           const float inv_scale, const float offset, const uint n) {
+    const uint gid = get_global_id(0);
+    if (gid >= n) return;
+
+    const uint denorm_magic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+    uint       f            = as_uint(in[gid]);
+    const uint sign         = f & 0x80000000u;
+    f ^= sign;
+
+    uint h;
+    if (f >= ((127u + 16u) << 23)) {
+        h = (f > (255u << 23)) ? 0x7e00u : 0x7c00u;
+    } else if (f < (113u << 23)) {
+        h = as_uint(as_float(f) + as_float(denorm_magic)) - denorm_magic;
+    } else {
+        const uint mantissa_odd = (f >> 13) & 1u;
+        f += ((15u - 127u) << 23) + 0xfffu;
+        f += mantissa_odd;
+        h = f >> 13;
+    }
+    out[gid] = (ushort)(h | (sign >> 16));
+}
+)CL";
+
+static const char* _cl_conversion_bfloat16 = R"CL(
+__kernel void mpoi_widen (__global const ushort* in, __global float* out,
+                          const float scale, const float offset, const uint n) {
+    const uint gid = get_global_id(0);
+    if (gid < n) out[gid] = as_float((uint)in[gid] << 16);
+}
+
+__kernel void mpoi_narrow (__global const float* in, __global ushort* out,
+                           const float inv_scale, const float offset, const uint n) {
+    const uint gid = get_global_id(0);
+    if (gid >= n) return;
+
+    const uint f = as_uint(in[gid]);
+    if ((f & 0x7fffffffu) > 0x7f800000u)
+        out[gid] = (ushort)((f >> 16) | 0x40u);
+    else
+        out[gid] = (ushort)((f + 0x7fffu + ((f >> 16) & 1u)) >> 16);
+}
+)CL";
+
+static const char* _cl_conversion_int8 = R"CL(
+__kernel void mpoi_widen (__global const char* in, __global float* out,
+                          const float scale, const float offset, const uint n) {
+    const uint gid = get_global_id(0);
+    if (gid < n) out[gid] = convert_float(in[gid]) * scale + offset;
+}
+
+__kernel void mpoi_narrow (__global const float* in, __global char* out,
+                           const float inv_scale, const float offset, const uint n) {
+    const uint gid = get_global_id(0);
+    if (gid < n) out[gid] = convert_char_sat_rte((in[gid] - offset) * inv_scale);
+}
+)CL";
+
+static std::size_t
+_storage_size (const mpoi::storage_format format) {
+    switch (format) {
+    case mpoi::storage_format::FLOAT16:
+    case mpoi::storage_format::BFLOAT16:
+        return sizeof (cl_ushort);
+    case mpoi::storage_format::INT8:
+        return sizeof (cl_char);
+    default:
+        return sizeof (cl_float);
+    }
+}
+
 void
 mpoi::build_program (const std::string& src_file) {
     std::ifstream in (src_file);
@@ -137,26 +334,34 @@ mpoi::build_program (const std::string& src_file) {
         std::cerr << "OpenCL program source not found: " << src_file << std::endl;
         exit (1);
     }
-    std::string       src ((std::istreambuf_iterator<char> (in)), std::istreambuf_iterator<char>());
+    std::string src ((std::istreambuf_iterator<char> (in)), std::istreambuf_iterator<char>());
+
+    _program = _build_program_source (src);
+}
+
+cl_program
+mpoi::_build_program_source (const std::string& body) {
+    // `#line 1` keeps the line numbers of build logs relative to `body`.
+    const std::string src        = _cl_prelude + std::string ("#line 1\n") + body;
     const char*       src_string = src.c_str();
     const std::size_t src_length = src.length();
     cl_int            err;
 
-    _program = clCreateProgramWithSource (
+    cl_program program = clCreateProgramWithSource (
         _context, 1, (const char**)&src_string, (const std::size_t*)&src_length, &err
     );
     if (err != CL_SUCCESS) {
         std::cerr << "Error in creating a program.\n";
     }
 
-    err = clBuildProgram (_program, 1, &_device_id, NULL, NULL, NULL);
+    err = clBuildProgram (program, 1, &_device_id, NULL, NULL, NULL);
 
     if (err != CL_SUCCESS) {
         std::cerr << "Error in building a program.\n";
         cl_build_status build_status;
 
         clGetProgramBuildInfo (
-            _program,
+            program,
             _device_id,
             CL_PROGRAM_BUILD_STATUS,
             sizeof (cl_build_status),
@@ -167,20 +372,21 @@ mpoi::build_program (const std::string& src_file) {
         if (build_status != CL_SUCCESS) {
             std::size_t ret_val_size;
             clGetProgramBuildInfo (
-                _program, _device_id, CL_PROGRAM_BUILD_LOG, 0, NULL, &ret_val_size
+                program, _device_id, CL_PROGRAM_BUILD_LOG, 0, NULL, &ret_val_size
             );
 
             auto build_log = std::make_unique<char[]> (ret_val_size + 1);
 
             clGetProgramBuildInfo (
-                _program, _device_id, CL_PROGRAM_BUILD_LOG, ret_val_size, build_log.get(), NULL
+                program, _device_id, CL_PROGRAM_BUILD_LOG, ret_val_size, build_log.get(), NULL
             );
 
             build_log[ret_val_size] = '\0';
 
-            std::cerr << "BUILD LOG: " << build_log << std::endl;
+            std::cerr << "BUILD LOG: " << build_log.get() << std::endl;
         }
     }
+    return program;
 }
 
 std::size_t
@@ -191,6 +397,27 @@ mpoi::create_kernel (const std::string& name) {
     return id;
 }
 
+std::size_t
+mpoi::create_kernel_from_source (const std::string& src, const std::string& name) {
+    const std::string key = name + '\n' + src;
+    auto              it  = _source_kernels.find (key);
+    if (it != _source_kernels.end()) {
+        return it->second;
+    }
+
+    cl_program program = _build_program_source (src);
+    _programs.push_back (program);
+
+    std::size_t id = _kernels.size();
+    cl_int      err;
+    _kernels.push_back (clCreateKernel (program, name.c_str(), &err));
+    if (err != CL_SUCCESS) {
+        std::cerr << "Error in creating a kernel: " << name << std::endl;
+    }
+    _source_kernels[key] = id;
+    return id;
+}
+
 void
 mpoi::display_platform_info () const {
     cl_uint num_platforms;
@@ -237,64 +464,327 @@ mpoi::_display_platform_info (cl_platform_id id, cl_platform_info name, std::str
 
 std::size_t
 mpoi::create_buffer (mpoi::buffer_property bp, const std::size_t sz) {
+    _buffer& buffer = _buffers[_next_key];
+    buffer.mem      = NULL;
+    buffer.property = bp;
+    buffer.size     = sz;
+    buffer.last_use = ++_clock;
 
-    cl_int err;
-    cl_mem buffer       = clCreateBuffer (_context, bp, sz, NULL, &err);
-    _buffers[_next_key] = buffer;
+    if (!_allocate_buffer (buffer, {})) {
+        std::cerr << "Error in creating a buffer of " << sz << " bytes.\n";
+    }
     _next_key++;
     return _next_key - 1;
 }
 
 void
 mpoi::release_buffer (const std::size_t id) {
-    if (_buffers[id] != NULL) {
-        clReleaseMemObject (_buffers[id]);
-        _buffers[id] = NULL;
+    auto typed = _typed_buffers.find (id);
+    if (typed != _typed_buffers.end()) {
+        const std::size_t staging = typed->second.staging;
+        _typed_buffers.erase (typed);
+        if (staging != id) release_buffer (staging);
+    }
+
+    _batch_tables.erase (id);
+
+    auto it = _buffers.find (id);
+    if (it == _buffers.end()) return;
+
+    if (it->second.mem != NULL) {
+        clReleaseMemObject (it->second.mem);
+        _stats.resident_bytes -= it->second.size;
+    }
+    _buffers.erase (it);
+
+    for (auto& [kernel_id, args] : _bindings) {
+        for (auto arg = args.begin(); arg != args.end();) {
+            if (arg->second.buffer == id) arg = args.erase (arg);
+            else ++arg;
+        }
     }
 }
 
 void
 mpoi::enqueue_write_buffer (const std::size_t id, const std::size_t size, const void* mem) {
-    if (_buffers[id] != NULL) {
+    _write_buffer (id, size, mem);
+}
+
+void
+mpoi::enqueue_read_buffer (const std::size_t id, const std::size_t size, void* mem) {
+    _read_buffer (id, size, mem);
+}
+
+bool
+mpoi::_write_buffer (const std::size_t id, const std::size_t size, const void* mem) {
+    cl_mem buffer = _acquire_buffer (id);
+    if (buffer == NULL) return false;
+
+    cl_int err = clEnqueueWriteBuffer (_cmd_queue, buffer, CL_TRUE, 0, size, mem, 0, NULL, NULL);
+    if (err != CL_SUCCESS && _evict_after_failure (err, std::span (&id, 1))) {
+        err = clEnqueueWriteBuffer (_cmd_queue, buffer, CL_TRUE, 0, size, mem, 0, NULL, NULL);
+    }
+    if (err != CL_SUCCESS) {
+        std::cerr << "Error in enqueuing a write buffer.\n";
+        return false;
+    }
+    return true;
+}
+
+bool
+mpoi::_read_buffer (const std::size_t id, const std::size_t size, void* mem) {
+    auto it = _buffers.find (id);
+    if (it == _buffers.end()) return false;
+
+    // An evicted buffer is read from its host copy without bringing it back.
+    if (it->second.mem == NULL && !it->second.host.empty()) {
+        _stats.misses++;
+        it->second.last_use = ++_clock;
+        std::memcpy (mem, it->second.host.data(), std::min (size, it->second.host.size()));
+        return true;
+    }
+
+    cl_mem buffer = _acquire_buffer (id);
+    if (buffer == NULL) return false;
+
+    cl_int err = clEnqueueReadBuffer (_cmd_queue, buffer, CL_TRUE, 0, size, mem, 0, NULL, NULL);
+    if (err != CL_SUCCESS) {
+        std::cerr << "Error in enqueuing a read buffer.\n";
+        return false;
+    }
+    return true;
+}
+
+std::size_t
+mpoi::create_typed_buffer (
+    mpoi::storage_format format,
+    const std::size_t    count,
+    const cl_float       scale,
+    const cl_float       offset
+) {
+    if (format == mpoi::storage_format::INT8 && (scale == 0.f || !std::isfinite (scale))) {
+        std::cerr << "The scale of an INT8 buffer must be finite and non-zero.\n";
+        exit (1);
+    }
+
+    // The conversion kernels write the float buffer on upload and read it on
+    // read-back, whatever the kernels of the caller do with it.
+    const std::size_t id =
+        create_buffer (mpoi::buffer_property::READ_WRITE, count * sizeof (cl_float));
+
+    std::size_t staging = id;
+    if (format != mpoi::storage_format::FLOAT32) {
+        staging =
+            create_buffer (mpoi::buffer_property::READ_WRITE, count * _storage_size (format));
+    }
+    _typed_buffers[id] = _typed_buffer{format, staging, count, scale, offset};
+    return id;
+}
+
+void
+mpoi::enqueue_write_typed_buffer (const std::size_t id, const std::size_t count, const float* mem) {
+    auto it = _typed_buffers.find (id);
+    if (it == _typed_buffers.end()) {
+        std::cerr << "Not a typed buffer: " << id << std::endl;
+        return;
+    }
+    const _typed_buffer& typed = it->second;
+    if (count > typed.count) {
+        std::cerr << "Cannot write " << count << " elements to a typed buffer of " << typed.count
+                  << ".\n";
+        return;
+    }
+
+    bool written = false;
+    switch (typed.format) {
+    case mpoi::storage_format::FLOAT16: {
+        auto compact = std::make_unique_for_overwrite<cl_ushort[]> (count);
+        mpoi_precision::float_to_half (mem, compact.get(), count);
+        written = _write_buffer (typed.staging, count * sizeof (cl_ushort), compact.get());
+        break;
+    }
+    case mpoi::storage_format::BFLOAT16: {
+        auto compact = std::make_unique_for_overwrite<cl_ushort[]> (count);
+        mpoi_precision::float_to_bfloat16 (mem, compact.get(), count);
+        written = _write_buffer (typed.staging, count * sizeof (cl_ushort), compact.get());
+        break;
+    }
+    case mpoi::storage_format::INT8: {
+        auto compact = std::make_unique_for_overwrite<std::int8_t[]> (count);
+        mpoi_precision::float_to_int8 (mem, compact.get(), count, 1.f / typed.scale, typed.offset);
+        written = _write_buffer (typed.staging, count * sizeof (cl_char), compact.get());
+        break;
+    }
+    default:
+        _write_buffer (id, count * sizeof (cl_float), mem);
+        return;
+    }
+    if (!written) return;
+
+    const std::size_t kernel_id = _conversion_kernel (typed.format, false);
+    const cl_uint     n         = static_cast<cl_uint> (count);
+    set_kernel_argument (kernel_id, 0, typed.staging);
+    set_kernel_argument (kernel_id, 1, id);
+    set_kernel_argument (kernel_id, 2, sizeof (cl_float), &typed.scale);
+    set_kernel_argument (kernel_id, 3, sizeof (cl_float), &typed.offset);
+    set_kernel_argument (kernel_id, 4, sizeof (cl_uint), &n);
+    enqueue_data_parallel_kernel (kernel_id, 128, count);
+}
+
+void
+mpoi::enqueue_read_typed_buffer (const std::size_t id, const std::size_t count, float* mem) {
+    auto it = _typed_buffers.find (id);
+    if (it == _typed_buffers.end()) {
+        std::cerr << "Not a typed buffer: " << id << std::endl;
+        return;
+    }
+    const _typed_buffer& typed = it->second;
+    if (count > typed.count) {
+        std::cerr << "Cannot read " << count << " elements from a typed buffer of " << typed.count
+                  << ".\n";
+        return;
+    }
+
+    if (typed.format == mpoi::storage_format::FLOAT32) {
+        enqueue_read_buffer (id, count * sizeof (cl_float), mem);
+        return;
+    }
+
+    const std::size_t kernel_id = _conversion_kernel (typed.format, true);
+    const cl_float    inv_scale = 1.f / typed.scale;
+    const cl_uint     n         = static_cast<cl_uint> (count);
+    set_kernel_argument (kernel_id, 0, id);
+    set_kernel_argument (kernel_id, 1, typed.staging);
+    set_kernel_argument (kernel_id, 2, sizeof (cl_float), &inv_scale);
+    set_kernel_argument (kernel_id, 3, sizeof (cl_float), &typed.offset);
+    set_kernel_argument (kernel_id, 4, sizeof (cl_uint), &n);
+    enqueue_data_parallel_kernel (kernel_id, 128, count);
+
+    switch (typed.format) {
+    case mpoi::storage_format::FLOAT16: {
+        auto compact = std::make_unique_for_overwrite<cl_ushort[]> (count);
+        if (_read_buffer (typed.staging, count * sizeof (cl_ushort), compact.get())) {
+            mpoi_precision::half_to_float (compact.get(), mem, count);
+        }
+        break;
+    }
+    case mpoi::storage_format::BFLOAT16: {
+        auto compact = std::make_unique_for_overwrite<cl_ushort[]> (count);
+        if (_read_buffer (typed.staging, count * sizeof (cl_ushort), compact.get())) {
+            mpoi_precision::bfloat16_to_float (compact.get(), mem, count);
+        }
+        break;
+    }
+    default: {
+        auto compact = std::make_unique_for_overwrite<std::int8_t[]> (count);
+        if (_read_buffer (typed.staging, count * sizeof (cl_char), compact.get())) {
+            mpoi_precision::int8_to_float (compact.get(), mem, count, typed.scale, typed.offset);
+        }
+        break;
+    }
+    }
+}
+
+void
+mpoi::enqueue_copy_buffer (
+    const std::size_t src_id,
+    const std::size_t dst_id,
+    const std::size_t size
+) {
+    enqueue_copy_buffer (src_id, dst_id, size, 0, 0);
+}
+
+void
+mpoi::enqueue_copy_buffer (
+    const std::size_t src_id,
+    const std::size_t dst_id,
+    const std::size_t size,
+    const std::size_t src_offset,
+    const std::size_t dst_offset
+) {
+    const std::size_t ids[] = {src_id, dst_id};
+    cl_mem            src   = _acquire_buffer (src_id, ids);
+    cl_mem            dst   = _acquire_buffer (dst_id, ids);
+    if ((src != NULL) && (dst != NULL)) {
         cl_int err =
-            clEnqueueWriteBuffer (_cmd_queue, _buffers[id], CL_TRUE, 0, size, mem, 0, NULL, NULL);
+            clEnqueueCopyBuffer (_cmd_queue, src, dst, src_offset, dst_offset, size, 0, NULL, NULL);
+        if (err != CL_SUCCESS && _evict_after_failure (err, ids)) {
+            err = clEnqueueCopyBuffer (
+                _cmd_queue, src, dst, src_offset, dst_offset, size, 0, NULL, NULL
+            );
+        }
         if (err != CL_SUCCESS) {
-            std::cerr << "Error in enqueuing a write buffer.\n";
+            std::cerr << "Error in enqueuing a copy buffer.\n";
             return;
         }
     }
 }
 
 void
-mpoi::enqueue_read_buffer (const std::size_t id, const std::size_t size, void* mem) {
-    if (_buffers[id] != NULL) {
+mpoi::enqueue_fill_buffer (
+    const std::size_t id,
+    const std::size_t size,
+    const void*       pattern,
+    const std::size_t pattern_size
+) {
+    // OpenCL accepts patterns of 1, 2, 4, ..., 128 bytes repeated over the whole range.
+    if (pattern_size == 0 || pattern_size > 128 || (pattern_size & (pattern_size - 1)) != 0 ||
+        size % pattern_size != 0) {
+        std::cerr << "Invalid fill pattern size: " << pattern_size << std::endl;
+        return;
+    }
+
+    cl_mem buffer = _acquire_buffer (id);
+    if (buffer != NULL) {
         cl_int err =
-            clEnqueueReadBuffer (_cmd_queue, _buffers[id], CL_TRUE, 0, size, mem, 0, NULL, NULL);
+            clEnqueueFillBuffer (_cmd_queue, buffer, pattern, pattern_size, 0, size, 0, NULL, NULL);
+        if (err != CL_SUCCESS && _evict_after_failure (err, std::span (&id, 1))) {
+            err = clEnqueueFillBuffer (
+                _cmd_queue, buffer, pattern, pattern_size, 0, size, 0, NULL, NULL
+            );
+        }
         if (err != CL_SUCCESS) {
-            std::cerr << "Error in enqueuing a read buffer.\n";
+            std::cerr << "Error in enqueuing a fill buffer.\n";
             return;
         }
     }
 }
 
+void
+mpoi::enqueue_zero_buffer (const std::size_t id, const std::size_t size) {
+    const cl_uchar zero = 0;
+    enqueue_fill_buffer (id, size, &zero, sizeof (cl_uchar));
+}
+
 void
 mpoi::set_kernel_argument (
     const std::size_t kernel_id,
     const std::size_t order,
     const std::size_t buffer_id
 ) {
-    if ((_kernels[kernel_id] != NULL) && (_buffers[buffer_id] != NULL)) {
+    if (_kernels[kernel_id] == NULL) return;
+
+    // A previous buffer bound at `order` must not be re-bound at launch.
+    _bindings[kernel_id].erase (order);
+
+    auto it = _buffers.find (buffer_id);
+    if (it == _buffers.end()) {
+        std::cerr << "Error in setting a kernel argument!\n";
+        return;
+    }
+
+    // An evicted buffer is brought back, and set, at launch.
+    cl_mem buffer = it->second.mem;
+    if (buffer != NULL) {
         cl_int err = clSetKernelArg (
-            _kernels[kernel_id],
-            static_cast<cl_uint> (order),
-            sizeof (cl_mem),
-            (void*)&(_buffers[buffer_id])
+            _kernels[kernel_id], static_cast<cl_uint> (order), sizeof (cl_mem), (void*)&buffer
         );
         if (err != CL_SUCCESS) {
             std::cerr << "Error in setting a kernel argument!\n";
             return;
         }
     }
+    _bindings[kernel_id][order] = _binding{buffer_id, buffer};
 }
 
 void
@@ -311,6 +801,7 @@ mpoi::set_kernel_argument (
             std::cerr << "Error in setting a kernel argument!\n";
             return;
         }
+        _bindings[id].erase (order);
     }
 }
 
@@ -321,13 +812,22 @@ mpoi::enqueue_data_parallel_kernel (
     std::size_t       num_global_items
 ) {
     if (_kernels[id] != NULL) {
+        if (!_bind_kernel_buffers (id)) {
+            std::cerr << "Error in binding the buffers of a kernel.\n";
+            return;
+        }
         for (; num_local_items != 1; num_local_items--) {
             if (num_global_items % num_local_items == 0) break;
         }
-        std::cout << "Local item size = " << num_local_items << std::endl;
+        if (_verbose) std::cout << "Local item size = " << num_local_items << std::endl;
         cl_int err = clEnqueueNDRangeKernel (
             _cmd_queue, _kernels[id], 1, NULL, &num_global_items, NULL, 0, NULL, NULL
         );
+        if (err != CL_SUCCESS && _evict_after_failure (err, _kernel_buffers (id))) {
+            err = clEnqueueNDRangeKernel (
+                _cmd_queue, _kernels[id], 1, NULL, &num_global_items, NULL, 0, NULL, NULL
+            );
+        }
         if (err != CL_SUCCESS) {
             std::cerr << "Error in enqueuing nd range kernel.\n";
             return;
@@ -343,19 +843,278 @@ mpoi::enqueue_data_parallel_kernel (
     std::size_t       num_global_items_y
 ) {
     if (_kernels[id] != NULL) {
+        if (!_bind_kernel_buffers (id)) {
+            std::cerr << "Error in binding the buffers of a kernel.\n";
+            return;
+        }
         const std::size_t num_global_items = num_global_items_x * num_global_items_y;
         std::size_t       global_size[2]   = {num_global_items_x, num_global_items_y};
 
         for (; num_local_items != 1; num_local_items--) {
             if (num_global_items % num_local_items == 0) break;
         }
-        std::cout << "Local item size = " << num_local_items << std::endl;
+        if (_verbose) std::cout << "Local item size = " << num_local_items << std::endl;
         cl_int err = clEnqueueNDRangeKernel (
             _cmd_queue, _kernels[id], 2, NULL, global_size, NULL, 0, NULL, NULL
         );
+        if (err != CL_SUCCESS && _evict_after_failure (err, _kernel_buffers (id))) {
+            err = clEnqueueNDRangeKernel (
+                _cmd_queue, _kernels[id], 2, NULL, global_size, NULL, 0, NULL, NULL
+            );
+        }
         if (err != CL_SUCCESS) {
             std::cerr << "Error in enqueuing nd range kernel.\n";
             return;
         }
     }
 }
+
+void
+mpoi::set_verbose (const bool verbose) {
+    _verbose = verbose;
+}
+
+std::size_t
+mpoi::create_batch_offsets (const std::vector<cl_uint>& offsets) {
+    // mpoi_batch_problem() does a binary search over the table on the device.
+    if (offsets.empty() || offsets[0] != 0 ||
+        std::adjacent_find (offsets.begin(), offsets.end(), std::greater<cl_uint>()) !=
+            offsets.end()) {
+        std::cerr << "Batch offsets must start at 0 and be non-decreasing.\n";
+        exit (1);
+    }
+
+    const std::size_t size   = offsets.size() * sizeof (cl_uint);
+    const std::size_t buffer = create_buffer (mpoi::buffer_property::READ_ONLY, size);
+    enqueue_write_buffer (buffer, size, offsets.data());
+
+    if (offsets.size() >= 2) {
+        const cl_uint count   = static_cast<cl_uint> (offsets.size() - 1);
+        _batch_tables[buffer] = _batch_table{count, offsets.back()};
+    }
+    return buffer;
+}
+
+void
+mpoi::enqueue_batched_kernel (
+    const std::size_t id,
+    const std::size_t order,
+    const std::size_t offsets_buffer,
+    std::size_t       num_local_items
+) {
+    auto it = _batch_tables.find (offsets_buffer);
+    if (it == _batch_tables.end()) {
+        std::cerr << "Not a batch offsets buffer (or empty batch): " << offsets_buffer << std::endl;
+        return;
+    }
+    const _batch_table table = it->second;
+
+    set_kernel_argument (id, order, offsets_buffer);
+    set_kernel_argument (id, order + 1, sizeof (cl_uint), &table.count);
+
+    enqueue_data_parallel_kernel (id, num_local_items, table.total_size);
+}
+
+void
+mpoi::set_memory_budget (const std::size_t budget) {
+    _stats.budget = budget;
+    while (_stats.resident_bytes > _stats.budget && _evict_lru_buffer ({})) {}
+}
+
+std::size_t
+mpoi::memory_budget () const {
+    return _stats.budget;
+}
+
+mpoi::residency_stats
+mpoi::residency_statistics () const {
+    return _stats;
+}
+
+cl_mem
+mpoi::_acquire_buffer (const std::size_t id, std::span<const std::size_t> pinned) {
+    auto it = _buffers.find (id);
+    if (it == _buffers.end()) return NULL;
+
+    _buffer& buffer = it->second;
+    buffer.last_use = ++_clock;
+
+    if (buffer.mem != NULL) {
+        _stats.hits++;
+        return buffer.mem;
+    }
+
+    _stats.misses++;
+    if (!_allocate_buffer (buffer, pinned)) {
+        std::cerr << "Error in restoring an evicted buffer.\n";
+        return NULL;
+    }
+
+    if (!buffer.host.empty()) {
+        cl_int err = clEnqueueWriteBuffer (
+            _cmd_queue,
+            buffer.mem,
+            CL_TRUE,
+            0,
+            buffer.host.size(),
+            buffer.host.data(),
+            0,
+            NULL,
+            NULL
+        );
+        if (err != CL_SUCCESS) {
+            // Keep the host copy, which is the only one, and stay evicted.
+            std::cerr << "Error in restoring an evicted buffer.\n";
+            clReleaseMemObject (buffer.mem);
+            buffer.mem = NULL;
+            _stats.resident_bytes -= buffer.size;
+            return NULL;
+        }
+        _stats.bytes_restored += buffer.host.size();
+        buffer.host = std::vector<unsigned char>();
+    }
+    return buffer.mem;
+}
+
+bool
+mpoi::_allocate_buffer (_buffer& buffer, std::span<const std::size_t> pinned) {
+    while (_stats.resident_bytes + buffer.size > _stats.budget && _evict_lru_buffer (pinned)) {}
+
+    // Allocation may still fail below the budget (fragmentation, other
+    // processes), so keep evicting until it succeeds or nothing is left.
+    for (;;) {
+        cl_int err;
+        buffer.mem = clCreateBuffer (_context, buffer.property, buffer.size, NULL, &err);
+        if (err == CL_SUCCESS) {
+            _stats.resident_bytes += buffer.size;
+            return true;
+        }
+        buffer.mem = NULL;
+        if ((err != CL_MEM_OBJECT_ALLOCATION_FAILURE && err != CL_OUT_OF_RESOURCES) ||
+            !_evict_lru_buffer (pinned)) {
+            return false;
+        }
+    }
+}
+
+bool
+mpoi::_evict_lru_buffer (std::span<const std::size_t> pinned) {
+    // Buffers which cannot be read back stay resident and are skipped.
+    std::set<std::size_t> failed;
+    for (;;) {
+        _buffer*    lru    = NULL;
+        std::size_t lru_id = 0;
+        for (auto& [id, buffer] : _buffers) {
+            if (buffer.mem == NULL || failed.count (id) ||
+                std::find (pinned.begin(), pinned.end(), id) != pinned.end()) {
+                continue;
+            }
+            if (lru == NULL || buffer.last_use < lru->last_use) {
+                lru    = &buffer;
+                lru_id = id;
+            }
+        }
+        if (lru == NULL) return false;
+        if (_evict_buffer (*lru)) return true;
+        failed.insert (lru_id);
+    }
+}
+
+bool
+mpoi::_evict_buffer (_buffer& buffer) {
+    buffer.host.resize (buffer.size);
+    cl_int err = clEnqueueReadBuffer (
+        _cmd_queue, buffer.mem, CL_TRUE, 0, buffer.size, buffer.host.data(), 0, NULL, NULL
+    );
+    if (err != CL_SUCCESS) {
+        std::cerr << "Error in evicting a buffer.\n";
+        buffer.host = std::vector<unsigned char>();
+        return false;
+    }
+    clReleaseMemObject (buffer.mem);
+    buffer.mem = NULL;
+
+    _stats.resident_bytes -= buffer.size;
+    _stats.bytes_evicted += buffer.size;
+    _stats.evictions++;
+    return true;
+}
+
+bool
+mpoi::_bind_kernel_buffers (const std::size_t kernel_id) {
+    auto it = _bindings.find (kernel_id);
+    if (it == _bindings.end()) return true;
+
+    for (auto& [order, binding] : it->second) {
+        // All the buffers of the kernel must be resident at the same time,
+        // which only matters when one of them has to be brought back.
+        auto entry = _buffers.find (binding.buffer);
+        if (entry == _buffers.end()) return false;
+
+        cl_mem buffer = entry->second.mem != NULL
+                            ? _acquire_buffer (binding.buffer)
+                            : _acquire_buffer (binding.buffer, _kernel_buffers (kernel_id));
+        if (buffer == NULL) return false;
+
+        // Arguments are set again only for buffers which moved since.
+        if (buffer != binding.mem) {
+            cl_int err = clSetKernelArg (
+                _kernels[kernel_id], static_cast<cl_uint> (order), sizeof (cl_mem), (void*)&buffer
+            );
+            if (err != CL_SUCCESS) return false;
+            binding.mem = buffer;
+        }
+    }
+    return true;
+}
+
+std::vector<std::size_t>
+mpoi::_kernel_buffers (const std::size_t kernel_id) const {
+    std::vector<std::size_t> ids;
+    auto                     it = _bindings.find (kernel_id);
+    if (it != _bindings.end()) {
+        for (const auto& [order, binding] : it->second) {
+            ids.push_back (binding.buffer);
+        }
+    }
+    return ids;
+}
+
+bool
+mpoi::_evict_after_failure (const cl_int err, std::span<const std::size_t> pinned) {
+    // Most drivers allocate device memory lazily, on the first command using
+    // a buffer, so running out of memory is reported there rather than by
+    // clCreateBuffer.  Make room for the buffers of the command.
+    if (err != CL_MEM_OBJECT_ALLOCATION_FAILURE && err != CL_OUT_OF_RESOURCES) return false;
+
+    std::size_t needed = 0;
+    for (const std::size_t id : pinned) {
+        auto it = _buffers.find (id);
+        if (it != _buffers.end()) needed += it->second.size;
+    }
+
+    std::size_t freed = 0;
+    while (freed < needed) {
+        const std::size_t resident = _stats.resident_bytes;
+        if (!_evict_lru_buffer (pinned)) break;
+        freed += resident - _stats.resident_bytes;
+    }
+    return freed > 0;
+}
+
+std::size_t
+mpoi::_conversion_kernel (const mpoi::storage_format format, const bool narrow) {
+    std::string src = _cl_conversion_header;
+    switch (format) {
+    case mpoi::storage_format::FLOAT16:
+        src += _has_fp16 ? _cl_conversion_float16 : _cl_conversion_float16_emulated;
+        break;
+    case mpoi::storage_format::BFLOAT16:
+        src += _cl_conversion_bfloat16;
+        break;
+    default:
+        src += _cl_conversion_int8;
+        break;
+    }
+    return create_kernel_from_source (src, narrow ? "mpoi_narrow" : "mpoi_widen");
+}
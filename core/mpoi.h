@@ -7,10 +7,13 @@
 #include <CL/cl.h>
 #endif
 
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <iterator>
 #include <map>
+#include <set>
+#include <span>
 #include <vector>
 
 class mpoi {
@@ -21,15 +24,81 @@ class mpoi {
         READ_WRITE = CL_MEM_READ_WRITE
     };
 
+    // Storage and transfer formats of typed buffers (see create_typed_buffer)
+    enum storage_format {
+        FLOAT32,   // 4 bytes, no conversion
+        FLOAT16,   // IEEE 754 half, 2 bytes
+        BFLOAT16,  // upper half of a float, 2 bytes
+        INT8       // x = q * scale + offset, 1 byte
+    };
+
+    // Device memory residency statistics.  A hit is a use of a buffer that
+    // was resident on the device; a miss is a use that had to bring an
+    // evicted buffer back from host memory.  Each write, read, copy, fill or
+    // launch counts one use of every buffer it touches.
+    struct residency_stats {
+        std::size_t hits           = 0;
+        std::size_t misses         = 0;
+        std::size_t evictions      = 0;
+        std::size_t bytes_evicted  = 0;
+        std::size_t bytes_restored = 0;
+        std::size_t resident_bytes = 0;
+        std::size_t budget         = 0;
+    };
+
   private:
-    cl_device_id                  _device_id;
-    cl_context                    _context;
-    cl_command_queue              _cmd_queue;
-    cl_program                    _program;
-    std::vector<cl_kernel>        _kernels;
-    std::map<std::size_t, cl_mem> _buffers;
-    std::size_t                   _next_key;
-    std::string                   _src;
+    // A device buffer.  When evicted, `mem` is NULL and the contents are
+    // kept in `host` until the buffer is used again.
+    struct _buffer {
+        cl_mem                     mem;
+        buffer_property            property;
+        std::size_t                size;
+        std::uint64_t              last_use;
+        std::vector<unsigned char> host;
+    };
+
+    // A buffer argument of a kernel and the cl_mem last set for it, so that
+    // launches only set the arguments of buffers moved by residency.
+    struct _binding {
+        std::size_t buffer;
+        cl_mem      mem;
+    };
+
+    // Size of an offsets table uploaded by create_batch_offsets
+    struct _batch_table {
+        cl_uint count;
+        cl_uint total_size;
+    };
+
+    // A float buffer transferred in a reduced-precision format through a
+    // compact `staging` buffer.
+    struct _typed_buffer {
+        storage_format format;
+        std::size_t    staging;
+        std::size_t    count;
+        cl_float       scale;
+        cl_float       offset;
+    };
+
+    cl_device_id                         _device_id;
+    cl_context                           _context;
+    cl_command_queue                     _cmd_queue;
+    cl_program                           _program;
+    std::vector<cl_kernel>               _kernels;
+    std::vector<cl_program>              _programs;        // built from in-memory sources
+    std::map<std::string, std::size_t>   _source_kernels;  // name and source -> kernel id
+    std::map<std::size_t, _buffer>       _buffers;
+    std::map<std::size_t, _batch_table>  _batch_tables;    // offsets buffer id -> size
+    std::map<std::size_t, _typed_buffer> _typed_buffers;   // float buffer id -> format
+    std::size_t                          _next_key;
+    std::string                          _src;
+
+    // Buffer arguments of each kernel (kernel id -> argument order -> buffer)
+    std::map<std::size_t, std::map<std::size_t, _binding>> _bindings;
+    std::uint64_t                                          _clock;
+    residency_stats                                        _stats;
+    bool                                                   _has_fp16;
+    bool                                                   _verbose;
 
   public:
     mpoi ();
@@ -46,6 +115,12 @@ class mpoi {
     std::size_t
     create_kernel (const std::string&);
 
+    // Builds a kernel from OpenCL source held in memory (e.g. generated at
+    // run time).  Kernels are cached: the same source and name are only
+    // compiled once.
+    std::size_t
+    create_kernel_from_source (const std::string&, const std::string&);
+
     void
     display_platform_info () const;
 
@@ -73,10 +148,106 @@ class mpoi {
     void
     enqueue_data_parallel_kernel (const std::size_t, std::size_t, std::size_t, std::size_t);
 
+    // Typed buffers hold `count` floats on the device, but are written and
+    // read in a reduced-precision format: the host narrows the data, only the
+    // compact representation crosses the bus, and a kernel widens it to float
+    // on the device (and the reverse on read-back).  The returned id is that
+    // of the float buffer, to be used as any other buffer; it is always
+    // READ_WRITE, since the conversion kernels both write and read it.
+    // FLOAT16 uses cl_khr_fp16 when the device supports it and integer
+    // emulation otherwise.  The INT8 scale must be finite and non-zero.
+    // Transfers of more than `count` elements are rejected.
+    std::size_t
+    create_typed_buffer (
+        mpoi::storage_format, const std::size_t, const cl_float = 1.f, const cl_float = 0.f
+    );
+
+    void
+    enqueue_write_typed_buffer (const std::size_t, const std::size_t, const float*);
+
+    void
+    enqueue_read_typed_buffer (const std::size_t, const std::size_t, float*);
+
+    // Device-side operations; the data never goes through the host.
+    void
+    enqueue_copy_buffer (const std::size_t, const std::size_t, const std::size_t);
+
+    void
+    enqueue_copy_buffer (
+        const std::size_t, const std::size_t, const std::size_t, const std::size_t,
+        const std::size_t
+    );
+
+    void
+    enqueue_fill_buffer (const std::size_t, const std::size_t, const void*, const std::size_t);
+
+    void
+    enqueue_zero_buffer (const std::size_t, const std::size_t);
+
+    // Batched launch: uploads an offsets table (see mpoi_batch) and returns its buffer id.
+    // The table must start at 0 and be non-decreasing.
+    std::size_t
+    create_batch_offsets (const std::vector<cl_uint>&);
+
+    // Binds the offsets buffer and the problem count to arguments `order` and
+    // `order + 1`, then launches one work item per element of the whole batch.
+    // The problem count and the work size are those of the uploaded table.
+    void
+    enqueue_batched_kernel (const std::size_t, const std::size_t, const std::size_t, std::size_t);
+
+    // Prints the local item size of every launch (default: true).
+    void
+    set_verbose (const bool);
+
+    // Device memory residency.  Buffers are evicted to host memory in least
+    // recently used order when the budget (by default the device global
+    // memory size) would be exceeded, and restored when used again.
+    void
+    set_memory_budget (const std::size_t);
+
+    std::size_t
+    memory_budget () const;
+
+    residency_stats
+    residency_statistics () const;
+
   private:
     void
     _setup_opencl ();
 
+    cl_program
+    _build_program_source (const std::string&);
+
+    cl_mem
+    _acquire_buffer (const std::size_t, std::span<const std::size_t> = {});
+
+    bool
+    _allocate_buffer (_buffer&, std::span<const std::size_t>);
+
+    bool
+    _evict_lru_buffer (std::span<const std::size_t>);
+
+    bool
+    _evict_buffer (_buffer&);
+
+    bool
+    _write_buffer (const std::size_t, const std::size_t, const void*);
+
+    bool
+    _read_buffer (const std::size_t, const std::size_t, void*);
+
+    bool
+    _bind_kernel_buffers (const std::size_t);
+
+    std::vector<std::size_t>
+    _kernel_buffers (const std::size_t) const;
+
+    bool
+    _evict_after_failure (const cl_int, std::span<const std::size_t>);
+
+    std::size_t
+    _conversion_kernel (const mpoi::storage_format, const bool);
+
     void
     _cleanup_opencl ();
 
@@ -0,0 +1,124 @@
+#ifndef __MULTI_PROCESSING_OBJECT_INTERFACE_BATCH_H_
+#define __MULTI_PROCESSING_OBJECT_INTERFACE_BATCH_H_
+
+#include "mpoi.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+// Packs many small, independent problems of variable size into one
+// contiguous array plus an offsets table, so that they can be processed by a
+// single kernel launch (see mpoi::enqueue_batched_kernel).
+//
+// Problem p occupies elements [offsets()[p], offsets()[p + 1]) of data().
+// Inside a kernel, the helpers mpoi_batch_problem(), mpoi_batch_local_id()
+// and mpoi_batch_problem_size() map a global id back to its problem.
+template <typename T>
+class mpoi_batch {
+  private:
+    std::vector<T>       _data;
+    std::vector<cl_uint> _offsets;
+
+  public:
+    mpoi_batch ()
+        : _offsets{0} {}
+
+    // Creates a value-initialized batch with the same layout as `layout`,
+    // e.g. to receive the results of a batched kernel.
+    template <typename U>
+    static mpoi_batch
+    like (const mpoi_batch<U>& layout) {
+        mpoi_batch b;
+        b._data.resize (layout.size());
+        b._offsets = layout.offsets();
+        return b;
+    }
+
+    // The offsets are 32-bit on the device, so a batch holds at most
+    // UINT_MAX elements.
+    std::size_t
+    add (const T* mem, const std::size_t count) {
+        if (count > std::numeric_limits<cl_uint>::max() - _data.size()) {
+            std::cerr << "A batch cannot hold more than " << std::numeric_limits<cl_uint>::max()
+                      << " elements.\n";
+            exit (1);
+        }
+        _data.insert (_data.end(), mem, mem + count);
+        _offsets.push_back (static_cast<cl_uint> (_data.size()));
+        return _offsets.size() - 2;
+    }
+
+    std::size_t
+    add (const std::vector<T>& v) {
+        return add (v.data(), v.size());
+    }
+
+    void
+    clear () {
+        _data.clear();
+        _offsets.assign (1, 0);
+    }
+
+    // Number of problems in the batch
+    std::size_t
+    count () const {
+        return _offsets.size() - 1;
+    }
+
+    // Total number of elements over all problems
+    std::size_t
+    size () const {
+        return _data.size();
+    }
+
+    std::size_t
+    bytes () const {
+        return _data.size() * sizeof (T);
+    }
+
+    std::size_t
+    size_of (const std::size_t i) const {
+        return _offsets[i + 1] - _offsets[i];
+    }
+
+    T*
+    data () {
+        return _data.data();
+    }
+
+    const T*
+    data () const {
+        return _data.data();
+    }
+
+    T*
+    data_of (const std::size_t i) {
+        return _data.data() + _offsets[i];
+    }
+
+    const T*
+    data_of (const std::size_t i) const {
+        return _data.data() + _offsets[i];
+    }
+
+    const std::vector<cl_uint>&
+    offsets () const {
+        return _offsets;
+    }
+
+    // Copies problem i out of the packed array.
+    void
+    scatter (const std::size_t i, T* mem) const {
+        std::copy (data_of (i), data_of (i) + size_of (i), mem);
+    }
+
+    void
+    scatter (const std::size_t i, std::vector<T>& v) const {
+        v.assign (data_of (i), data_of (i) + size_of (i));
+    }
+};
+
+#endif
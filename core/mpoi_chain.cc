@@ -0,0 +1,90 @@
+#include "mpoi_chain.h"
+
+mpoi_chain::mpoi_chain (mpoi& pc)
+    : _pc (pc) {}
+
+mpoi_chain::~mpoi_chain () { _release_buffers(); }
+
+mpoi_chain&
+mpoi_chain::add_stage (
+    const std::size_t kernel_id,
+    const std::size_t output_size,
+    std::size_t       num_local_items,
+    std::size_t       num_global_items
+) {
+    return add_stage (kernel_id, output_size, num_local_items, num_global_items, 0);
+}
+
+mpoi_chain&
+mpoi_chain::add_stage (
+    const std::size_t kernel_id,
+    const std::size_t output_size,
+    std::size_t       num_local_items,
+    std::size_t       num_global_items_x,
+    std::size_t       num_global_items_y
+) {
+    _stages.push_back (_stage{
+        kernel_id, output_size, num_local_items, num_global_items_x, num_global_items_y, 0, false
+    });
+    return *this;
+}
+
+std::size_t
+mpoi_chain::run (const std::size_t input_buffer) {
+    std::size_t input = input_buffer;
+
+    for (_stage& stage : _stages) {
+        if (!stage.allocated) {
+            stage.output_buffer =
+                _pc.create_buffer (mpoi::buffer_property::READ_WRITE, stage.output_size);
+            stage.allocated = true;
+        }
+
+        _pc.set_kernel_argument (stage.kernel_id, 0, input);
+        _pc.set_kernel_argument (stage.kernel_id, 1, stage.output_buffer);
+
+        if (stage.num_global_items_y == 0) {
+            _pc.enqueue_data_parallel_kernel (
+                stage.kernel_id, stage.num_local_items, stage.num_global_items_x
+            );
+        } else {
+            _pc.enqueue_data_parallel_kernel (
+                stage.kernel_id,
+                stage.num_local_items,
+                stage.num_global_items_x,
+                stage.num_global_items_y
+            );
+        }
+
+        input = stage.output_buffer;
+    }
+
+    return input;
+}
+
+void
+mpoi_chain::run (
+    const std::size_t input_buffer,
+    const std::size_t input_size,
+    const void*       input,
+    void*             output
+) {
+    _pc.enqueue_write_buffer (input_buffer, input_size, input);
+    const std::size_t output_buffer = run (input_buffer);
+    _pc.enqueue_read_buffer (output_buffer, output_size(), output);
+}
+
+std::size_t
+mpoi_chain::output_size () const {
+    return _stages.empty() ? 0 : _stages.back().output_size;
+}
+
+void
+mpoi_chain::_release_buffers () {
+    for (_stage& stage : _stages) {
+        if (stage.allocated) {
+            _pc.release_buffer (stage.output_buffer);
+            stage.allocated = false;
+        }
+    }
+}
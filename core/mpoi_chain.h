@@ -0,0 +1,64 @@
+#ifndef __MULTI_PROCESSING_OBJECT_INTERFACE_CHAIN_H_
+#define __MULTI_PROCESSING_OBJECT_INTERFACE_CHAIN_H_
+
+#include "mpoi.h"
+
+#include <vector>
+
+// A sequence of kernels where the output buffer of each stage becomes the
+// input buffer of the next one, without any round-trip through the host.
+//
+// Every stage kernel takes its input buffer as argument 0 and its output
+// buffer as argument 1.  Other arguments (sizes, constants, ...) are set
+// beforehand with mpoi::set_kernel_argument().
+class mpoi_chain {
+  private:
+    struct _stage {
+        std::size_t kernel_id;
+        std::size_t output_size;
+        std::size_t num_local_items;
+        std::size_t num_global_items_x;
+        std::size_t num_global_items_y;  // 0 for 1-D stages
+        std::size_t output_buffer;
+        bool        allocated;
+    };
+
+    mpoi&               _pc;
+    std::vector<_stage> _stages;
+
+  public:
+    mpoi_chain (mpoi&);
+    mpoi_chain (const mpoi_chain&) = delete;
+    virtual ~mpoi_chain ();
+
+    mpoi_chain&
+    operator= (const mpoi_chain&) = delete;
+
+    // Appends a 1-D stage producing `output_size` bytes.
+    mpoi_chain&
+    add_stage (const std::size_t, const std::size_t, std::size_t, std::size_t);
+
+    // Appends a 2-D stage producing `output_size` bytes.
+    mpoi_chain&
+    add_stage (const std::size_t, const std::size_t, std::size_t, std::size_t, std::size_t);
+
+    // Runs all the stages on `input_buffer` and returns the buffer holding
+    // the output of the last stage.  Buffers are owned by the chain and
+    // reused by subsequent runs.
+    std::size_t
+    run (const std::size_t);
+
+    // Writes `input_size` bytes to `input_buffer`, runs the chain and reads
+    // the output of the last stage back to `output`.
+    void
+    run (const std::size_t, const std::size_t, const void*, void*);
+
+    std::size_t
+    output_size () const;
+
+  private:
+    void
+    _release_buffers ();
+};
+
+#endif
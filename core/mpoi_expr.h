@@ -0,0 +1,314 @@
+#ifndef __MULTI_PROCESSING_OBJECT_INTERFACE_EXPR_H_
+#define __MULTI_PROCESSING_OBJECT_INTERFACE_EXPR_H_
+
+#include "mpoi.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Element-wise expressions over device buffers of `float`, e.g.
+//
+//     mpoi_expr::device_vector a (a_buffer, size), b (b_buffer, size), c (c_buffer, size);
+//     auto term = sin (a) * cos (b);
+//     mpoi_expr::evaluate (pc, c, exp (term + sign (term) * cos (a) * sin (b)));
+//
+// The whole expression is turned into the source of a single OpenCL kernel,
+// so intermediate values stay in registers and the data is read and written
+// only once.  The source depends only on the shape of the expression (scalar
+// constants are passed as kernel arguments), and mpoi caches the compiled
+// kernel by source, so each distinct expression is compiled once.
+namespace mpoi_expr {
+
+// Collects the arguments of a fused kernel while its source is generated.
+class kernel_builder {
+  private:
+    std::vector<std::size_t> _buffers;
+    std::vector<std::size_t> _sizes;
+    std::vector<cl_float>    _scalars;
+
+  public:
+    // Returns the name of the register holding the element of a buffer of
+    // `size` elements.
+    std::string
+    buffer (const std::size_t id, const std::size_t size) {
+        for (std::size_t i = 0; i != _buffers.size(); i++) {
+            if (_buffers[i] == id) {
+                _sizes[i] = std::min (_sizes[i], size);
+                return "v" + std::to_string (i);
+            }
+        }
+        _buffers.push_back (id);
+        _sizes.push_back (size);
+        return "v" + std::to_string (_buffers.size() - 1);
+    }
+
+    std::string
+    scalar (const cl_float value) {
+        _scalars.push_back (value);
+        return "s" + std::to_string (_scalars.size() - 1);
+    }
+
+    const std::vector<std::size_t>&
+    buffers () const {
+        return _buffers;
+    }
+
+    const std::vector<std::size_t>&
+    sizes () const {
+        return _sizes;
+    }
+
+    const std::vector<cl_float>&
+    scalars () const {
+        return _scalars;
+    }
+};
+
+template <typename E>
+struct expr {
+    const E&
+    self () const {
+        return static_cast<const E&> (*this);
+    }
+};
+
+// A device buffer of `size` floats created with mpoi::create_buffer().
+class device_vector : public expr<device_vector> {
+  private:
+    std::size_t _buffer;
+    std::size_t _size;
+
+  public:
+    device_vector (const std::size_t buffer, const std::size_t size)
+        : _buffer (buffer)
+        , _size (size) {}
+
+    std::size_t
+    buffer () const {
+        return _buffer;
+    }
+
+    std::size_t
+    size () const {
+        return _size;
+    }
+
+    std::string
+    code (kernel_builder& kb) const {
+        return kb.buffer (_buffer, _size);
+    }
+};
+
+class scalar : public expr<scalar> {
+  private:
+    cl_float _value;
+
+  public:
+    scalar (const cl_float value)
+        : _value (value) {}
+
+    std::string
+    code (kernel_builder& kb) const {
+        return kb.scalar (_value);
+    }
+};
+
+// Nodes hold their operands by value: terminals are only a few words, and
+// expressions may be built from temporaries.
+template <typename Op, typename E>
+class unary_expr : public expr<unary_expr<Op, E>> {
+  private:
+    E _e;
+
+  public:
+    unary_expr (const E& e)
+        : _e (e) {}
+
+    std::string
+    code (kernel_builder& kb) const {
+        return Op::code (_e.code (kb));
+    }
+};
+
+template <typename Op, typename L, typename R>
+class binary_expr : public expr<binary_expr<Op, L, R>> {
+  private:
+    L _l;
+    R _r;
+
+  public:
+    binary_expr (const L& l, const R& r)
+        : _l (l)
+        , _r (r) {}
+
+    std::string
+    code (kernel_builder& kb) const {
+        const std::string l = _l.code (kb);
+        return Op::code (l, _r.code (kb));
+    }
+};
+
+#define MPOI_EXPR_UNARY_FUNCTION(fn)                                                               \
+    struct op_##fn {                                                                               \
+        static std::string                                                                         \
+        code (const std::string& e) {                                                              \
+            return #fn "(" + e + ")";                                                              \
+        }                                                                                          \
+    };                                                                                             \
+                                                                                                   \
+    template <typename E>                                                                          \
+    unary_expr<op_##fn, E>                                                                         \
+    fn (const expr<E>& e) {                                                                        \
+        return unary_expr<op_##fn, E> (e.self());                                                  \
+    }
+
+MPOI_EXPR_UNARY_FUNCTION (sin)
+MPOI_EXPR_UNARY_FUNCTION (cos)
+MPOI_EXPR_UNARY_FUNCTION (tan)
+MPOI_EXPR_UNARY_FUNCTION (exp)
+MPOI_EXPR_UNARY_FUNCTION (log)
+MPOI_EXPR_UNARY_FUNCTION (sqrt)
+MPOI_EXPR_UNARY_FUNCTION (fabs)
+MPOI_EXPR_UNARY_FUNCTION (sign)
+
+#undef MPOI_EXPR_UNARY_FUNCTION
+
+struct op_negate {
+    static std::string
+    code (const std::string& e) {
+        return "(-" + e + ")";
+    }
+};
+
+template <typename E>
+unary_expr<op_negate, E>
+operator- (const expr<E>& e) {
+    return unary_expr<op_negate, E> (e.self());
+}
+
+#define MPOI_EXPR_BINARY_OPERATOR(name, op)                                                        \
+    struct name {                                                                                  \
+        static std::string                                                                         \
+        code (const std::string& l, const std::string& r) {                                        \
+            return "(" + l + " " #op " " + r + ")";                                                \
+        }                                                                                          \
+    };                                                                                             \
+                                                                                                   \
+    template <typename L, typename R>                                                              \
+    binary_expr<name, L, R>                                                                        \
+    operator op (const expr<L>& l, const expr<R>& r) {                                             \
+        return binary_expr<name, L, R> (l.self(), r.self());                                       \
+    }                                                                                              \
+                                                                                                   \
+    template <typename L>                                                                          \
+    binary_expr<name, L, scalar>                                                                   \
+    operator op (const expr<L>& l, const cl_float r) {                                             \
+        return binary_expr<name, L, scalar> (l.self(), scalar (r));                                \
+    }                                                                                              \
+                                                                                                   \
+    template <typename R>                                                                          \
+    binary_expr<name, scalar, R>                                                                   \
+    operator op (const cl_float l, const expr<R>& r) {                                             \
+        return binary_expr<name, scalar, R> (scalar (l), r.self());                                \
+    }
+
+MPOI_EXPR_BINARY_OPERATOR (op_add, +)
+MPOI_EXPR_BINARY_OPERATOR (op_subtract, -)
+MPOI_EXPR_BINARY_OPERATOR (op_multiply, *)
+MPOI_EXPR_BINARY_OPERATOR (op_divide, /)
+
+#undef MPOI_EXPR_BINARY_OPERATOR
+
+#define MPOI_EXPR_BINARY_FUNCTION(fn)                                                              \
+    struct op_##fn {                                                                               \
+        static std::string                                                                         \
+        code (const std::string& l, const std::string& r) {                                        \
+            return #fn "(" + l + ", " + r + ")";                                                   \
+        }                                                                                          \
+    };                                                                                             \
+                                                                                                   \
+    template <typename L, typename R>                                                              \
+    binary_expr<op_##fn, L, R>                                                                     \
+    fn (const expr<L>& l, const expr<R>& r) {                                                      \
+        return binary_expr<op_##fn, L, R> (l.self(), r.self());                                    \
+    }                                                                                              \
+                                                                                                   \
+    template <typename L>                                                                          \
+    binary_expr<op_##fn, L, scalar>                                                                \
+    fn (const expr<L>& l, const cl_float r) {                                                      \
+        return binary_expr<op_##fn, L, scalar> (l.self(), scalar (r));                             \
+    }
+
+MPOI_EXPR_BINARY_FUNCTION (pow)
+MPOI_EXPR_BINARY_FUNCTION (fmin)
+MPOI_EXPR_BINARY_FUNCTION (fmax)
+
+#undef MPOI_EXPR_BINARY_FUNCTION
+
+// Generates the source of the kernel `mpoi_fused` computing `out = e`.
+// The arguments of the kernel are the buffers and the scalars collected in
+// `kb`, in that order, followed by the output buffer and the element count.
+template <typename E>
+std::string
+generate_source (const expr<E>& e, kernel_builder& kb) {
+    const std::string value = e.self().code (kb);
+
+    std::string src = "__kernel void mpoi_fused (\n";
+    for (std::size_t i = 0; i != kb.buffers().size(); i++) {
+        src += "    __global const float* in" + std::to_string (i) + ",\n";
+    }
+    for (std::size_t i = 0; i != kb.scalars().size(); i++) {
+        src += "    const float s" + std::to_string (i) + ",\n";
+    }
+    src += "    __global float* out,\n";
+    src += "    const uint n\n";
+    src += ") {\n";
+    src += "    const uint gid = get_global_id(0);\n";
+    src += "    if (gid >= n)\n";
+    src += "        return;\n";
+    for (std::size_t i = 0; i != kb.buffers().size(); i++) {
+        const std::string j = std::to_string (i);
+        src += "    const float v" + j + " = in" + j + "[gid];\n";
+    }
+    src += "    out[gid] = " + value + ";\n";
+    src += "}\n";
+
+    return src;
+}
+
+// Computes `out = e` on the device with a single fused kernel.  Nothing is
+// launched if an input of `e` is smaller than `out`.
+template <typename E>
+void
+evaluate (mpoi& pc, const device_vector& out, const expr<E>& e, std::size_t num_local_items = 128) {
+    kernel_builder    kb;
+    const std::string src = generate_source (e, kb);
+
+    for (const std::size_t size : kb.sizes()) {
+        if (size < out.size()) {
+            std::cerr << "An input of the expression is smaller than its output.\n";
+            return;
+        }
+    }
+
+    const std::size_t kernel_id = pc.create_kernel_from_source (src, "mpoi_fused");
+
+    std::size_t order = 0;
+    for (const std::size_t buffer : kb.buffers()) {
+        pc.set_kernel_argument (kernel_id, order++, buffer);
+    }
+    for (const cl_float& s : kb.scalars()) {
+        pc.set_kernel_argument (kernel_id, order++, sizeof (cl_float), &s);
+    }
+    const cl_uint n = static_cast<cl_uint> (out.size());
+    pc.set_kernel_argument (kernel_id, order++, out.buffer());
+    pc.set_kernel_argument (kernel_id, order++, sizeof (cl_uint), &n);
+
+    pc.enqueue_data_parallel_kernel (kernel_id, num_local_items, out.size());
+}
+
+}  // namespace mpoi_expr
+
+#endif
@@ -0,0 +1,405 @@
+#include "mpoi_host_filter.h"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MPOI_HOST_FILTER_X86
+#include <immintrin.h>
+#endif
+
+#if defined(MPOI_HOST_FILTER_X86) && (defined(__GNUC__) || defined(__clang__))
+#define MPOI_HOST_FILTER_AVX2
+#define MPOI_TARGET_AVX2 __attribute__ ((target ("avx2")))
+#endif
+
+namespace {
+
+//// Scalar passes
+
+// Horizontal pass over one row, for output columns [x_begin, x_end).
+void
+horizontal_row_scalar (
+    const std::uint8_t*  in,
+    std::uint16_t*       tmp,
+    const int            width,
+    const std::uint16_t* taps,
+    const int            radius,
+    const int            x_begin,
+    const int            x_end
+) {
+    for (int x = x_begin; x < x_end; x++) {
+        std::uint32_t sum = 0;
+        for (int k = -radius; k <= radius; k++) {
+            sum += taps[k + radius] * in[std::clamp (x + k, 0, width - 1)];
+        }
+        tmp[x] = static_cast<std::uint16_t> (sum);
+    }
+}
+
+// Horizontal pass over the columns which need no clamping; returns the end
+// of the columns processed.
+int
+horizontal_row_interior (
+    const std::uint8_t*  in,
+    std::uint16_t*       tmp,
+    const int            width,
+    const std::uint16_t* taps,
+    const int            radius
+) {
+    int x = radius;
+    for (; x + radius < width; x++) {
+        std::uint32_t sum = 0;
+        for (int k = -radius; k <= radius; k++) {
+            sum += taps[k + radius] * in[x + k];
+        }
+        tmp[x] = static_cast<std::uint16_t> (sum);
+    }
+    return x;
+}
+
+// Vertical pass for one output row, for columns [x_begin, x_end).
+// `rows` points to the 2 * radius + 1 (clamped) input rows.
+void
+vertical_row_scalar (
+    const std::uint16_t* const* rows,
+    std::uint8_t*               out,
+    const std::uint16_t*        taps,
+    const int                   radius,
+    const int                   shift,
+    const int                   x_begin,
+    const int                   x_end
+) {
+    for (int x = x_begin; x < x_end; x++) {
+        std::uint32_t sum = 0;
+        for (int k = 0; k <= 2 * radius; k++) {
+            sum += std::uint32_t (taps[k]) * rows[k][x];
+        }
+        out[x] = static_cast<std::uint8_t> (sum >> shift);
+    }
+}
+
+#ifdef MPOI_HOST_FILTER_X86
+
+//// SSE2 passes
+
+// Returns the end of the columns processed; the rest is left to the scalar path.
+int
+horizontal_row_sse2 (
+    const std::uint8_t*  in,
+    std::uint16_t*       tmp,
+    const int            width,
+    const std::uint16_t* taps,
+    const int            radius
+) {
+    const __m128i zero = _mm_setzero_si128();
+
+    int x = radius;
+    for (; x + 16 + radius <= width; x += 16) {
+        __m128i lo = _mm_setzero_si128();
+        __m128i hi = _mm_setzero_si128();
+        for (int k = -radius; k <= radius; k++) {
+            const __m128i t = _mm_set1_epi16 (static_cast<short> (taps[k + radius]));
+            const __m128i p = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (in + x + k));
+            lo = _mm_add_epi16 (lo, _mm_mullo_epi16 (_mm_unpacklo_epi8 (p, zero), t));
+            hi = _mm_add_epi16 (hi, _mm_mullo_epi16 (_mm_unpackhi_epi8 (p, zero), t));
+        }
+        _mm_storeu_si128 (reinterpret_cast<__m128i*> (tmp + x), lo);
+        _mm_storeu_si128 (reinterpret_cast<__m128i*> (tmp + x + 8), hi);
+    }
+    return x;
+}
+
+int
+vertical_row_sse2 (
+    const std::uint16_t* const* rows,
+    std::uint8_t*               out,
+    const int                   width,
+    const std::uint16_t*        taps,
+    const int                   radius,
+    const int                   shift
+) {
+    const __m128i count = _mm_cvtsi32_si128 (shift);
+
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i acc0 = _mm_setzero_si128();
+        __m128i acc1 = _mm_setzero_si128();
+        for (int k = 0; k <= 2 * radius; k++) {
+            const __m128i t  = _mm_set1_epi16 (static_cast<short> (taps[k]));
+            const __m128i v  = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (rows[k] + x));
+            const __m128i lo = _mm_mullo_epi16 (v, t);
+            const __m128i hi = _mm_mulhi_epu16 (v, t);
+            acc0             = _mm_add_epi32 (acc0, _mm_unpacklo_epi16 (lo, hi));
+            acc1             = _mm_add_epi32 (acc1, _mm_unpackhi_epi16 (lo, hi));
+        }
+        acc0                 = _mm_srl_epi32 (acc0, count);
+        acc1                 = _mm_srl_epi32 (acc1, count);
+        const __m128i packed = _mm_packus_epi16 (_mm_packs_epi32 (acc0, acc1), acc0);
+        _mm_storel_epi64 (reinterpret_cast<__m128i*> (out + x), packed);
+    }
+    return x;
+}
+
+#endif
+
+#ifdef MPOI_HOST_FILTER_AVX2
+
+//// AVX2 passes
+
+MPOI_TARGET_AVX2 int
+horizontal_row_avx2 (
+    const std::uint8_t*  in,
+    std::uint16_t*       tmp,
+    const int            width,
+    const std::uint16_t* taps,
+    const int            radius
+) {
+    int x = radius;
+    for (; x + 16 + radius <= width; x += 16) {
+        __m256i acc = _mm256_setzero_si256();
+        for (int k = -radius; k <= radius; k++) {
+            const __m256i t = _mm256_set1_epi16 (static_cast<short> (taps[k + radius]));
+            const __m256i p = _mm256_cvtepu8_epi16 (
+                _mm_loadu_si128 (reinterpret_cast<const __m128i*> (in + x + k))
+            );
+            acc = _mm256_add_epi16 (acc, _mm256_mullo_epi16 (p, t));
+        }
+        _mm256_storeu_si256 (reinterpret_cast<__m256i*> (tmp + x), acc);
+    }
+    return x;
+}
+
+MPOI_TARGET_AVX2 int
+vertical_row_avx2 (
+    const std::uint16_t* const* rows,
+    std::uint8_t*               out,
+    const int                   width,
+    const std::uint16_t*        taps,
+    const int                   radius,
+    const int                   shift
+) {
+    const __m128i count = _mm_cvtsi32_si128 (shift);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i acc0 = _mm256_setzero_si256();
+        __m256i acc1 = _mm256_setzero_si256();
+        for (int k = 0; k <= 2 * radius; k++) {
+            const __m256i t  = _mm256_set1_epi16 (static_cast<short> (taps[k]));
+            const __m256i v  = _mm256_loadu_si256 (reinterpret_cast<const __m256i*> (rows[k] + x));
+            const __m256i lo = _mm256_mullo_epi16 (v, t);
+            const __m256i hi = _mm256_mulhi_epu16 (v, t);
+            acc0             = _mm256_add_epi32 (acc0, _mm256_unpacklo_epi16 (lo, hi));
+            acc1             = _mm256_add_epi32 (acc1, _mm256_unpackhi_epi16 (lo, hi));
+        }
+        acc0 = _mm256_srl_epi32 (acc0, count);
+        acc1 = _mm256_srl_epi32 (acc1, count);
+
+        // Packing works within 128-bit lanes: the low 8 bytes of each lane
+        // hold columns x..x+7 and x+8..x+15 respectively.
+        __m256i packed = _mm256_packus_epi16 (_mm256_packs_epi32 (acc0, acc1), acc0);
+        packed         = _mm256_permute4x64_epi64 (packed, 0x08);
+        _mm_storeu_si128 (reinterpret_cast<__m128i*> (out + x), _mm256_castsi256_si128 (packed));
+    }
+    return x;
+}
+
+#endif
+
+}  // namespace
+
+mpoi_host_filter::mpoi_host_filter (const std::vector<int>& taps, std::size_t num_threads)
+    : _radius (static_cast<int> (taps.size() / 2))
+    , _shift (0)
+    , _num_threads (0)
+    , _isa (best_instruction_set()) {
+    // The sum is checked against 256 as it is accumulated so that it cannot
+    // overflow; the shift is only computed for valid taps.
+    bool valid = taps.size() % 2 == 1;
+    int  sum   = 0;
+    for (std::size_t i = 0; valid && i != taps.size(); i++) {
+        valid = taps[i] >= 0 && taps[i] <= 256 - sum;
+        sum += valid ? taps[i] : 0;
+    }
+    valid = valid && sum > 0 && (sum & (sum - 1)) == 0;
+    if (!valid) {
+        std::cerr << "Filter taps must be an odd number of non-negative integers summing to a "
+                     "power of two not greater than 256.\n";
+        exit (1);
+    }
+    while ((1 << _shift) < sum) {
+        _shift++;
+    }
+    _shift *= 2;
+
+    _taps.assign (taps.begin(), taps.end());
+    set_num_threads (num_threads);
+}
+
+void
+mpoi_host_filter::apply (
+    const std::uint8_t* in,
+    std::uint8_t*       out,
+    const int           width,
+    const int           height
+) const {
+    if (width <= 0 || height <= 0) return;
+
+    // Each thread runs both passes over its own band of rows.  Its horizontal
+    // pass also covers the `radius` rows around the band, so that threads
+    // never wait for each other between the passes.
+    _parallel_rows (height, [&] (const int y_begin, const int y_end) {
+        const int tmp_begin = std::max (y_begin - _radius, 0);
+        const int tmp_rows  = std::min (y_end + _radius, height) - tmp_begin;
+
+        auto tmp = std::make_unique_for_overwrite<std::uint16_t[]> (std::size_t (tmp_rows) * width);
+        _horizontal_pass (in + std::size_t (tmp_begin) * width, tmp.get(), width, 0, tmp_rows);
+        _vertical_pass (tmp.get(), out, width, height, tmp_begin, y_begin, y_end);
+    });
+}
+
+std::vector<std::uint8_t>
+mpoi_host_filter::apply (
+    const std::vector<std::uint8_t>& in,
+    const int                        width,
+    const int                        height
+) const {
+    std::vector<std::uint8_t> out (in.size());
+    apply (in.data(), out.data(), width, height);
+    return out;
+}
+
+void
+mpoi_host_filter::set_instruction_set (const instruction_set isa) {
+    _isa = std::min (isa, best_instruction_set());
+}
+
+mpoi_host_filter::instruction_set
+mpoi_host_filter::get_instruction_set () const {
+    return _isa;
+}
+
+void
+mpoi_host_filter::set_num_threads (const std::size_t num_threads) {
+    _num_threads = num_threads;
+    if (_num_threads == 0) {
+        _num_threads = std::max (1u, std::thread::hardware_concurrency());
+    }
+}
+
+std::size_t
+mpoi_host_filter::get_num_threads () const {
+    return _num_threads;
+}
+
+mpoi_host_filter::instruction_set
+mpoi_host_filter::best_instruction_set () {
+#ifdef MPOI_HOST_FILTER_AVX2
+    if (__builtin_cpu_supports ("avx2")) return AVX2;
+#endif
+#ifdef MPOI_HOST_FILTER_X86
+    return SSE2;
+#else
+    return SCALAR;
+#endif
+}
+
+void
+mpoi_host_filter::_horizontal_pass (
+    const std::uint8_t* in,
+    std::uint16_t*      tmp,
+    const int           width,
+    const int           y_begin,
+    const int           y_end
+) const {
+    const std::uint16_t* taps = _taps.data();
+
+    for (int y = y_begin; y < y_end; y++) {
+        const std::uint8_t* row     = in + std::size_t (y) * width;
+        std::uint16_t*      tmp_row = tmp + std::size_t (y) * width;
+
+        // Columns closer than `radius` to the borders need clamping and
+        // always go through the scalar path.
+        int x;
+        switch (_isa) {
+#ifdef MPOI_HOST_FILTER_AVX2
+        case AVX2:
+            x = horizontal_row_avx2 (row, tmp_row, width, taps, _radius);
+            break;
+#endif
+#ifdef MPOI_HOST_FILTER_X86
+        case SSE2:
+            x = horizontal_row_sse2 (row, tmp_row, width, taps, _radius);
+            break;
+#endif
+        default:
+            x = horizontal_row_interior (row, tmp_row, width, taps, _radius);
+            break;
+        }
+        horizontal_row_scalar (row, tmp_row, width, taps, _radius, 0, std::min (_radius, width));
+        horizontal_row_scalar (row, tmp_row, width, taps, _radius, x, width);
+    }
+}
+
+void
+mpoi_host_filter::_vertical_pass (
+    const std::uint16_t* tmp,
+    std::uint8_t*        out,
+    const int            width,
+    const int            height,
+    const int            tmp_begin,
+    const int            y_begin,
+    const int            y_end
+) const {
+    const std::uint16_t*              taps = _taps.data();
+    std::vector<const std::uint16_t*> rows (_taps.size());
+
+    for (int y = y_begin; y < y_end; y++) {
+        for (int k = -_radius; k <= _radius; k++) {
+            const int row     = std::clamp (y + k, 0, height - 1) - tmp_begin;
+            rows[k + _radius] = tmp + std::size_t (row) * width;
+        }
+        std::uint8_t* out_row = out + std::size_t (y) * width;
+
+        int x = 0;
+        switch (_isa) {
+#ifdef MPOI_HOST_FILTER_AVX2
+        case AVX2:
+            x = vertical_row_avx2 (rows.data(), out_row, width, taps, _radius, _shift);
+            break;
+#endif
+#ifdef MPOI_HOST_FILTER_X86
+        case SSE2:
+            x = vertical_row_sse2 (rows.data(), out_row, width, taps, _radius, _shift);
+            break;
+#endif
+        default:
+            break;
+        }
+        vertical_row_scalar (rows.data(), out_row, taps, _radius, _shift, x, width);
+    }
+}
+
+template <typename F>
+void
+mpoi_host_filter::_parallel_rows (const int height, F f) const {
+    const int num_threads = static_cast<int> (std::min<std::size_t> (_num_threads, height));
+    if (num_threads <= 1) {
+        f (0, height);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve (num_threads - 1);
+    for (int i = 1; i < num_threads; i++) {
+        threads.emplace_back (f, height * i / num_threads, height * (i + 1) / num_threads);
+    }
+    f (0, height / num_threads);
+
+    for (std::thread& t : threads) {
+        t.join();
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef __MULTI_PROCESSING_OBJECT_INTERFACE_HOST_FILTER_H_
+#define __MULTI_PROCESSING_OBJECT_INTERFACE_HOST_FILTER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Separable convolution of 8-bit grayscale images on the host, as a baseline
+// for the OpenCL kernels and as a fallback on machines without an OpenCL
+// device.  It does not depend on OpenCL.
+//
+// The 2-D kernel is the outer product of `taps` with itself, normalized by
+// the square of the sum of the taps, with clamped borders.  The taps must be
+// non-negative and sum to a power of two not greater than 256 (e.g. the
+// binomial taps 1, 8, 28, 56, 70, 56, 28, 8, 1), so that all the arithmetic
+// is exact in 16/32-bit integers: the result is identical, pixel for pixel,
+// to a float implementation such as `gaussian_blur` in examples/kernel2.cl.
+//
+// The horizontal and vertical passes use SSE2 or AVX2 when available and are
+// split by rows over several threads.
+class mpoi_host_filter {
+  public:
+    enum instruction_set { SCALAR, SSE2, AVX2 };
+
+  private:
+    std::vector<std::uint16_t> _taps;
+    int                        _radius;
+    int                        _shift;  // log2 of the normalization
+    std::size_t                _num_threads;
+    instruction_set            _isa;
+
+  public:
+    // `num_threads` = 0 uses all the hardware threads.
+    mpoi_host_filter (const std::vector<int>&, std::size_t = 0);
+
+    // Filters a `width` x `height` image; `in` and `out` must not overlap.
+    void
+    apply (const std::uint8_t*, std::uint8_t*, const int, const int) const;
+
+    std::vector<std::uint8_t>
+    apply (const std::vector<std::uint8_t>&, const int, const int) const;
+
+    // Restricts the instruction set, e.g. to compare SIMD and scalar paths.
+    // Requests beyond what the CPU supports fall back to the best available.
+    void
+    set_instruction_set (const instruction_set);
+
+    instruction_set
+    get_instruction_set () const;
+
+    void
+    set_num_threads (const std::size_t);
+
+    std::size_t
+    get_num_threads () const;
+
+    static instruction_set
+    best_instruction_set ();
+
+  private:
+    void
+    _horizontal_pass (const std::uint8_t*, std::uint16_t*, const int, const int, const int) const;
+
+    // `tmp` holds the rows of the horizontal pass from `tmp_begin` on.
+    void
+    _vertical_pass (
+        const std::uint16_t*, std::uint8_t*, const int, const int, const int, const int, const int
+    ) const;
+
+    template <typename F>
+    void
+    _parallel_rows (const int, F) const;
+};
+
+#endif
@@ -0,0 +1,452 @@
+#include "mpoi_precision.h"
+
+#include <bit>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MPOI_PRECISION_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define MPOI_PRECISION_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(MPOI_PRECISION_X86) && (defined(__GNUC__) || defined(__clang__))
+#define MPOI_PRECISION_F16C
+#define MPOI_TARGET_F16C __attribute__ ((target ("avx,f16c")))
+#endif
+
+namespace {
+
+//// Scalar conversions
+
+// Round to nearest even, including subnormals, with the float unit doing the
+// rounding of subnormals (the emulated device conversion in mpoi.cc does the same).
+std::uint16_t
+half_from_float (const float x) {
+    const std::uint32_t f32_infinity = 255u << 23;
+    const std::uint32_t f16_max      = (127u + 16) << 23;
+    const std::uint32_t denorm_magic = ((127u - 15) + (23 - 10) + 1) << 23;
+
+    std::uint32_t       f    = std::bit_cast<std::uint32_t> (x);
+    const std::uint32_t sign = f & 0x80000000u;
+    f ^= sign;
+
+    std::uint16_t h;
+    if (f >= f16_max) {
+        h = (f > f32_infinity) ? 0x7e00 : 0x7c00;
+    } else if (f < (113u << 23)) {
+        const float sum = std::bit_cast<float> (f) + std::bit_cast<float> (denorm_magic);
+        h = static_cast<std::uint16_t> (std::bit_cast<std::uint32_t> (sum) - denorm_magic);
+    } else {
+        const std::uint32_t mantissa_odd = (f >> 13) & 1;
+        f += ((15u - 127) << 23) + 0xfff;
+        f += mantissa_odd;
+        h = static_cast<std::uint16_t> (f >> 13);
+    }
+    return h | static_cast<std::uint16_t> (sign >> 16);
+}
+
+float
+float_from_half (const std::uint16_t h) {
+    const std::uint32_t shifted_exp = 0x7c00u << 13;
+
+    std::uint32_t       f   = (h & 0x7fffu) << 13;
+    const std::uint32_t exp = f & shifted_exp;
+    f += (127u - 15) << 23;
+
+    if (exp == shifted_exp) {
+        f += (128u - 16) << 23;  // infinity or NaN
+    } else if (exp == 0) {
+        f += 1u << 23;  // subnormal: renormalize
+        f = std::bit_cast<std::uint32_t> (
+            std::bit_cast<float> (f) - std::bit_cast<float> (113u << 23)
+        );
+    }
+    return std::bit_cast<float> (f | (std::uint32_t (h & 0x8000u) << 16));
+}
+
+std::uint16_t
+bfloat16_from_float (const float x) {
+    const std::uint32_t f = std::bit_cast<std::uint32_t> (x);
+    if ((f & 0x7fffffffu) > 0x7f800000u) {
+        return static_cast<std::uint16_t> ((f >> 16) | 0x40);  // quiet NaN
+    }
+    return static_cast<std::uint16_t> ((f + 0x7fffu + ((f >> 16) & 1)) >> 16);
+}
+
+std::int8_t
+int8_from_float (const float x, const float inv_scale, const float offset) {
+    const float v = (x - offset) * inv_scale;
+    if (std::isnan (v)) return 0;
+    if (v <= -128.f) return -128;
+    if (v >= 127.f) return 127;
+    return static_cast<std::int8_t> (std::nearbyint (v));
+}
+
+#ifdef MPOI_PRECISION_F16C
+
+//// F16C conversions
+
+MPOI_TARGET_F16C std::size_t
+float_to_half_f16c (const float* in, std::uint16_t* out, const std::size_t count) {
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i h = _mm256_cvtps_ph (_mm256_loadu_ps (in + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128 (reinterpret_cast<__m128i*> (out + i), h);
+    }
+    return i;
+}
+
+MPOI_TARGET_F16C std::size_t
+half_to_float_f16c (const std::uint16_t* in, float* out, const std::size_t count) {
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i h = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (in + i));
+        _mm256_storeu_ps (out + i, _mm256_cvtph_ps (h));
+    }
+    return i;
+}
+
+bool
+has_f16c () {
+    static const bool supported = __builtin_cpu_supports ("f16c");
+    return supported;
+}
+
+#endif
+
+#ifdef MPOI_PRECISION_X86
+
+//// SSE2 conversions
+
+std::size_t
+float_to_bfloat16_sse2 (const float* in, std::uint16_t* out, const std::size_t count) {
+    const __m128i abs_mask = _mm_set1_epi32 (0x7fffffff);
+    const __m128i infinity = _mm_set1_epi32 (0x7f800000);
+    const __m128i bias     = _mm_set1_epi32 (0x7fff);
+    const __m128i one      = _mm_set1_epi32 (1);
+    const __m128i quiet    = _mm_set1_epi32 (0x400000);
+
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i r[2];
+        for (int j = 0; j != 2; j++) {
+            const __m128i f = _mm_castps_si128 (_mm_loadu_ps (in + i + 4 * j));
+            const __m128i nan     = _mm_cmpgt_epi32 (_mm_and_si128 (f, abs_mask), infinity);
+            const __m128i odd     = _mm_and_si128 (_mm_srli_epi32 (f, 16), one);
+            const __m128i rounded = _mm_add_epi32 (f, _mm_add_epi32 (bias, odd));
+            const __m128i quieted = _mm_or_si128 (f, quiet);
+            const __m128i v       = _mm_or_si128 (
+                _mm_and_si128 (nan, quieted), _mm_andnot_si128 (nan, rounded)
+            );
+            // Sign-extend the upper 16 bits so that the saturating pack keeps them as is.
+            r[j] = _mm_srai_epi32 (v, 16);
+        }
+        _mm_storeu_si128 (reinterpret_cast<__m128i*> (out + i), _mm_packs_epi32 (r[0], r[1]));
+    }
+    return i;
+}
+
+std::size_t
+bfloat16_to_float_sse2 (const std::uint16_t* in, float* out, const std::size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m128i h = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (in + i));
+        _mm_storeu_ps (out + i, _mm_castsi128_ps (_mm_unpacklo_epi16 (zero, h)));
+        _mm_storeu_ps (out + i + 4, _mm_castsi128_ps (_mm_unpackhi_epi16 (zero, h)));
+    }
+    return i;
+}
+
+std::size_t
+float_to_int8_sse2 (
+    const float*      in,
+    std::int8_t*      out,
+    const std::size_t count,
+    const float       inv_scale,
+    const float       offset
+) {
+    const __m128 s  = _mm_set1_ps (inv_scale);
+    const __m128 o  = _mm_set1_ps (offset);
+    const __m128 lo = _mm_set1_ps (-128.f);
+    const __m128 hi = _mm_set1_ps (127.f);
+
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i q[4];
+        for (int j = 0; j != 4; j++) {
+            __m128       v       = _mm_mul_ps (_mm_sub_ps (_mm_loadu_ps (in + i + 4 * j), o), s);
+            const __m128 ordered = _mm_cmpord_ps (v, v);
+            v                    = _mm_min_ps (_mm_max_ps (v, lo), hi);
+            q[j] = _mm_and_si128 (_mm_cvtps_epi32 (v), _mm_castps_si128 (ordered));
+        }
+        const __m128i packed =
+            _mm_packs_epi16 (_mm_packs_epi32 (q[0], q[1]), _mm_packs_epi32 (q[2], q[3]));
+        _mm_storeu_si128 (reinterpret_cast<__m128i*> (out + i), packed);
+    }
+    return i;
+}
+
+std::size_t
+int8_to_float_sse2 (
+    const std::int8_t* in,
+    float*             out,
+    const std::size_t  count,
+    const float        scale,
+    const float        offset
+) {
+    const __m128 s = _mm_set1_ps (scale);
+    const __m128 o = _mm_set1_ps (offset);
+
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const __m128i b    = _mm_loadu_si128 (reinterpret_cast<const __m128i*> (in + i));
+        const __m128i w0   = _mm_srai_epi16 (_mm_unpacklo_epi8 (b, b), 8);
+        const __m128i w1   = _mm_srai_epi16 (_mm_unpackhi_epi8 (b, b), 8);
+        const __m128i d[4] = {
+            _mm_srai_epi32 (_mm_unpacklo_epi16 (w0, w0), 16),
+            _mm_srai_epi32 (_mm_unpackhi_epi16 (w0, w0), 16),
+            _mm_srai_epi32 (_mm_unpacklo_epi16 (w1, w1), 16),
+            _mm_srai_epi32 (_mm_unpackhi_epi16 (w1, w1), 16),
+        };
+        for (int j = 0; j != 4; j++) {
+            const __m128 v = _mm_mul_ps (_mm_cvtepi32_ps (d[j]), s);
+            _mm_storeu_ps (out + i + 4 * j, _mm_add_ps (v, o));
+        }
+    }
+    return i;
+}
+
+#endif
+
+#ifdef MPOI_PRECISION_NEON
+
+//// NEON conversions
+
+std::size_t
+float_to_half_neon (const float* in, std::uint16_t* out, const std::size_t count) {
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const float16x4_t lo = vcvt_f16_f32 (vld1q_f32 (in + i));
+        const float16x4_t hi = vcvt_f16_f32 (vld1q_f32 (in + i + 4));
+        vst1q_u16 (out + i, vcombine_u16 (vreinterpret_u16_f16 (lo), vreinterpret_u16_f16 (hi)));
+    }
+    return i;
+}
+
+std::size_t
+half_to_float_neon (const std::uint16_t* in, float* out, const std::size_t count) {
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const uint16x8_t h = vld1q_u16 (in + i);
+        vst1q_f32 (out + i, vcvt_f32_f16 (vreinterpret_f16_u16 (vget_low_u16 (h))));
+        vst1q_f32 (out + i + 4, vcvt_f32_f16 (vreinterpret_f16_u16 (vget_high_u16 (h))));
+    }
+    return i;
+}
+
+std::size_t
+float_to_bfloat16_neon (const float* in, std::uint16_t* out, const std::size_t count) {
+    const uint32x4_t abs_mask = vdupq_n_u32 (0x7fffffff);
+    const uint32x4_t infinity = vdupq_n_u32 (0x7f800000);
+    const uint32x4_t bias     = vdupq_n_u32 (0x7fff);
+    const uint32x4_t one      = vdupq_n_u32 (1);
+    const uint32x4_t quiet    = vdupq_n_u32 (0x400000);
+
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint16x4_t r[2];
+        for (int j = 0; j != 2; j++) {
+            const uint32x4_t f       = vreinterpretq_u32_f32 (vld1q_f32 (in + i + 4 * j));
+            const uint32x4_t nan     = vcgtq_u32 (vandq_u32 (f, abs_mask), infinity);
+            const uint32x4_t odd     = vandq_u32 (vshrq_n_u32 (f, 16), one);
+            const uint32x4_t rounded = vaddq_u32 (f, vaddq_u32 (bias, odd));
+            const uint32x4_t v       = vbslq_u32 (nan, vorrq_u32 (f, quiet), rounded);
+            r[j]                     = vshrn_n_u32 (v, 16);
+        }
+        vst1q_u16 (out + i, vcombine_u16 (r[0], r[1]));
+    }
+    return i;
+}
+
+std::size_t
+bfloat16_to_float_neon (const std::uint16_t* in, float* out, const std::size_t count) {
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const uint16x8_t h = vld1q_u16 (in + i);
+        vst1q_f32 (out + i, vreinterpretq_f32_u32 (vshll_n_u16 (vget_low_u16 (h), 16)));
+        vst1q_f32 (out + i + 4, vreinterpretq_f32_u32 (vshll_n_u16 (vget_high_u16 (h), 16)));
+    }
+    return i;
+}
+
+std::size_t
+float_to_int8_neon (
+    const float*      in,
+    std::int8_t*      out,
+    const std::size_t count,
+    const float       inv_scale,
+    const float       offset
+) {
+    const float32x4_t s  = vdupq_n_f32 (inv_scale);
+    const float32x4_t o  = vdupq_n_f32 (offset);
+    const float32x4_t lo = vdupq_n_f32 (-128.f);
+    const float32x4_t hi = vdupq_n_f32 (127.f);
+
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        int16x4_t q[4];
+        for (int j = 0; j != 4; j++) {
+            float32x4_t v = vmulq_f32 (vsubq_f32 (vld1q_f32 (in + i + 4 * j), o), s);
+            // vmaxq/vminq propagate NaN, which vcvtnq then converts to 0.
+            v    = vminq_f32 (vmaxq_f32 (v, lo), hi);
+            q[j] = vqmovn_s32 (vcvtnq_s32_f32 (v));
+        }
+        const int8x16_t packed = vcombine_s8 (
+            vqmovn_s16 (vcombine_s16 (q[0], q[1])), vqmovn_s16 (vcombine_s16 (q[2], q[3]))
+        );
+        vst1q_s8 (out + i, packed);
+    }
+    return i;
+}
+
+std::size_t
+int8_to_float_neon (
+    const std::int8_t* in,
+    float*             out,
+    const std::size_t  count,
+    const float        scale,
+    const float        offset
+) {
+    const float32x4_t s = vdupq_n_f32 (scale);
+    const float32x4_t o = vdupq_n_f32 (offset);
+
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const int8x16_t b    = vld1q_s8 (in + i);
+        const int16x8_t w0   = vmovl_s8 (vget_low_s8 (b));
+        const int16x8_t w1   = vmovl_s8 (vget_high_s8 (b));
+        const int32x4_t d[4] = {
+            vmovl_s16 (vget_low_s16 (w0)),
+            vmovl_s16 (vget_high_s16 (w0)),
+            vmovl_s16 (vget_low_s16 (w1)),
+            vmovl_s16 (vget_high_s16 (w1)),
+        };
+        for (int j = 0; j != 4; j++) {
+            // Not fused, like the scalar path.
+            const float32x4_t v = vmulq_f32 (vcvtq_f32_s32 (d[j]), s);
+            vst1q_f32 (out + i + 4 * j, vaddq_f32 (v, o));
+        }
+    }
+    return i;
+}
+
+#endif
+
+}  // namespace
+
+namespace mpoi_precision {
+
+void
+float_to_half (const float* in, std::uint16_t* out, const std::size_t count) {
+    std::size_t i = 0;
+#ifdef MPOI_PRECISION_F16C
+    if (has_f16c()) i = float_to_half_f16c (in, out, count);
+#endif
+#ifdef MPOI_PRECISION_NEON
+    i = float_to_half_neon (in, out, count);
+#endif
+    for (; i != count; i++) {
+        out[i] = half_from_float (in[i]);
+    }
+}
+
+void
+half_to_float (const std::uint16_t* in, float* out, const std::size_t count) {
+    std::size_t i = 0;
+#ifdef MPOI_PRECISION_F16C
+    if (has_f16c()) i = half_to_float_f16c (in, out, count);
+#endif
+#ifdef MPOI_PRECISION_NEON
+    i = half_to_float_neon (in, out, count);
+#endif
+    for (; i != count; i++) {
+        out[i] = float_from_half (in[i]);
+    }
+}
+
+void
+float_to_bfloat16 (const float* in, std::uint16_t* out, const std::size_t count) {
+    std::size_t i = 0;
+#ifdef MPOI_PRECISION_X86
+    i = float_to_bfloat16_sse2 (in, out, count);
+#endif
+#ifdef MPOI_PRECISION_NEON
+    i = float_to_bfloat16_neon (in, out, count);
+#endif
+    for (; i != count; i++) {
+        out[i] = bfloat16_from_float (in[i]);
+    }
+}
+
+void
+bfloat16_to_float (const std::uint16_t* in, float* out, const std::size_t count) {
+    std::size_t i = 0;
+#ifdef MPOI_PRECISION_X86
+    i = bfloat16_to_float_sse2 (in, out, count);
+#endif
+#ifdef MPOI_PRECISION_NEON
+    i = bfloat16_to_float_neon (in, out, count);
+#endif
+    for (; i != count; i++) {
+        out[i] = std::bit_cast<float> (std::uint32_t (in[i]) << 16);
+    }
+}
+
+void
+float_to_int8 (
+    const float*      in,
+    std::int8_t*      out,
+    const std::size_t count,
+    const float       inv_scale,
+    const float       offset
+) {
+    std::size_t i = 0;
+#ifdef MPOI_PRECISION_X86
+    i = float_to_int8_sse2 (in, out, count, inv_scale, offset);
+#endif
+#ifdef MPOI_PRECISION_NEON
+    i = float_to_int8_neon (in, out, count, inv_scale, offset);
+#endif
+    for (; i != count; i++) {
+        out[i] = int8_from_float (in[i], inv_scale, offset);
+    }
+}
+
+void
+int8_to_float (
+    const std::int8_t* in,
+    float*             out,
+    const std::size_t  count,
+    const float        scale,
+    const float        offset
+) {
+    std::size_t i = 0;
+#ifdef MPOI_PRECISION_X86
+    i = int8_to_float_sse2 (in, out, count, scale, offset);
+#endif
+#ifdef MPOI_PRECISION_NEON
+    i = int8_to_float_neon (in, out, count, scale, offset);
+#endif
+    for (; i != count; i++) {
+        const float v = float (in[i]) * scale;
+        out[i]        = v + offset;
+    }
+}
+
+}  // namespace mpoi_precision
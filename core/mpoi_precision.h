@@ -0,0 +1,37 @@
+#ifndef __MULTI_PROCESSING_OBJECT_INTERFACE_PRECISION_H_
+#define __MULTI_PROCESSING_OBJECT_INTERFACE_PRECISION_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Host-side conversions between `float` and the reduced-precision transfer
+// formats of mpoi::create_typed_buffer().  Narrowing rounds to nearest even,
+// like the conversion kernels run on the device.  F16C and SSE2 are used
+// when available on x86-64, and NEON on AArch64.
+namespace mpoi_precision {
+
+// IEEE 754 binary16; overflow gives infinity.
+void
+float_to_half (const float*, std::uint16_t*, const std::size_t);
+
+void
+half_to_float (const std::uint16_t*, float*, const std::size_t);
+
+// bfloat16: the upper half of a float.
+void
+float_to_bfloat16 (const float*, std::uint16_t*, const std::size_t);
+
+void
+bfloat16_to_float (const std::uint16_t*, float*, const std::size_t);
+
+// Scaled int8: q = saturate (round ((x - offset) * inv_scale)), with NaN
+// mapped to 0, and x = q * scale + offset.
+void
+float_to_int8 (const float*, std::int8_t*, const std::size_t, const float, const float);
+
+void
+int8_to_float (const std::int8_t*, float*, const std::size_t, const float, const float);
+
+}  // namespace mpoi_precision
+
+#endif
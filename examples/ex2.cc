@@ -1,5 +1,8 @@
 #include "core/mpoi.h"
+#include "core/mpoi_chain.h"
+#include "core/mpoi_host_filter.h"
 
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 #include <cstdint>
@@ -63,9 +66,10 @@ write_pgm_binary (const std::string& filename, const Image& img) {
     file.write (reinterpret_cast<const char*> (img.pixels.data()), img.pixels.size());
 }
 
+// Fixed-point weights (0.299, 0.587, 0.114) * 256, identical to the `rgb_to_gray` kernel
 inline uint8_t
 rgb_to_gray (uint8_t r, uint8_t g, uint8_t b) {
-    return static_cast<uint8_t> (0.299 * r + 0.587 * g + 0.114 * b);
+    return static_cast<uint8_t> ((77 * r + 150 * g + 29 * b) >> 8);
 }
 
 Image
@@ -78,66 +82,45 @@ rgb_to_gray (const Image& img) {
     return Image{img.width, img.height, 1, std::move (pixels)};
 }
 
-//// Gaussian kernel
-struct GaussianKernel {
-    const int              denom = 65536;
-    const std::vector<int> params{
-        1,
-        8,
-        28,
-        56,
-        70,
-        56,
-        28,
-        8,
-        1,
-    };
-
-    int
-    size () const {
-        return params.size();
-    }
-
-    float
-    operator() (const std::size_t i, const std::size_t j) {
-        const int offset = std::floor (params.size() / 2);
-        return float (params[i + offset] * params[j + offset]) / float (denom);
+const char*
+isa_name (const mpoi_host_filter::instruction_set isa) {
+    switch (isa) {
+    case mpoi_host_filter::AVX2:
+        return "AVX2";
+    case mpoi_host_filter::SSE2:
+        return "SSE2";
+    default:
+        return "scalar";
     }
-};
-
-float
-pixel_convoluted (const Image& img, const int i, const int j) {
-    GaussianKernel kernel;
-    float          cv   = 0.f;
-    int            half = std::floor (kernel.size() / 2);
-
-    for (int jj : std::views::iota (-half, half + 1)) {
-        int sj = std::clamp (jj + j, 0, img.height - 1);
-        for (int ii : std::views::iota (-half, half + 1)) {
-            int si = std::clamp (ii + i, 0, img.width - 1);
-            cv += kernel (ii, jj) * img.pixels[sj * img.width + si];
-        }
-    }
-
-    return cv;
 }
 
-Image
-image_convoluted (const Image& img) {
-    std::vector<uint8_t> pixels (img.width * img.height);
-
-    for (int j : std::views::iota (0, img.height)) {
-        for (int i : std::views::iota (0, img.width)) {
-            pixels[j * img.width + i] = pixel_convoluted (img, i, j);
-        }
-    }
-    return Image{img.width, img.height, 1, std::move (pixels)};
-}
+//// Gaussian kernel, same weights as `gaussian_blur` in kernel2.cl
+const std::vector<int> gaussian_taps{1, 8, 28, 56, 70, 56, 28, 8, 1};
 
 int
-convolution_serial (const std::filesystem::path filepath, const bool save_gray = false) {
-    Image src  = read_ppm_binary (filepath.string());
+convolution_host (
+    const std::filesystem::path filepath,
+    Image&                      convoluted,
+    const bool                  save_gray = false
+) {
+    Image src = read_ppm_binary (filepath.string());
+
+    mpoi_host_filter filter (gaussian_taps);
+    std::cout << std::format (
+        "Host filter: {} thread(s), {}\n",
+        filter.get_num_threads(),
+        isa_name (filter.get_instruction_set())
+    );
+
+    // Gray conversion and convolution
+    auto  t0   = std::chrono::high_resolution_clock::now();
     Image gray = rgb_to_gray (src);
+    convoluted = Image{
+        gray.width, gray.height, 1, filter.apply (gray.pixels, gray.width, gray.height)
+    };
+    auto t1 = std::chrono::high_resolution_clock::now();
+    auto time_elapsed_usec =
+        static_cast<int> (duration_cast<std::chrono::microseconds> (t1 - t0).count());
 
     if (save_gray) {
         write_pgm_binary (
@@ -146,80 +129,80 @@ convolution_serial (const std::filesystem::path filepath, const bool save_gray =
         );
     }
 
-    // Convolution
-    auto  t0         = std::chrono::high_resolution_clock::now();
-    Image convoluted = image_convoluted (gray);
-    auto  t1         = std::chrono::high_resolution_clock::now();
-    auto  time_elapsed_msec =
-        static_cast<int> (duration_cast<std::chrono::milliseconds> (t1 - t0).count());
-
     write_pgm_binary (
         filepath.parent_path() / std::filesystem::path{filepath.stem().string() + "_blurred_s.pgm"},
         convoluted
     );
 
-    return time_elapsed_msec;
+    return time_elapsed_usec;
 }
 
 Image
-image_convoluted_parallel (const Image& img, mpoi& pc, const std::size_t kernel_id) {
-    const int size   = img.width * img.height;
-    const int width  = img.width;
-    const int height = img.height;
+image_convoluted_parallel (const Image& img, mpoi& pc, mpoi_chain& chain) {
+    const int size = img.width * img.height;
 
-    std::vector<uint8_t> pixels (img.width * img.height);
+    std::vector<uint8_t> pixels (size);
 
     std::size_t in_buffer =
-        pc.create_buffer (mpoi::buffer_property::READ_ONLY, size * sizeof (uint8_t));
-    std::size_t out_buffer =
-        pc.create_buffer (mpoi::buffer_property::READ_WRITE, size * sizeof (uint8_t));
-
-    pc.enqueue_write_buffer (in_buffer, size * sizeof (uint8_t), img.pixels.data());
-
-    pc.set_kernel_argument (kernel_id, 0, in_buffer);
-    pc.set_kernel_argument (kernel_id, 1, out_buffer);
-    pc.set_kernel_argument (kernel_id, 2, sizeof (int), &width);
-    pc.set_kernel_argument (kernel_id, 3, sizeof (int), &height);
-
-    pc.enqueue_data_parallel_kernel (kernel_id, 200, width, height);
+        pc.create_buffer (mpoi::buffer_property::READ_ONLY, size * img.channels * sizeof (uint8_t));
 
-    pc.enqueue_read_buffer (out_buffer, size * sizeof (uint8_t), pixels.data());
+    // RGB in, blurred grayscale out: the gray image stays on the device.
+    chain.run (in_buffer, size * img.channels * sizeof (uint8_t), img.pixels.data(), pixels.data());
 
     pc.release_buffer (in_buffer);
-    pc.release_buffer (out_buffer);
 
     return Image{img.width, img.height, 1, std::move (pixels)};
 }
 
 int
-convolution_parallel (const std::filesystem::path filepath) {
-    Image src  = read_ppm_binary (filepath.string());
-    Image gray = rgb_to_gray (src);
+convolution_parallel (const std::filesystem::path filepath, Image& convoluted) {
+    Image src = read_ppm_binary (filepath.string());
 
     mpoi pc ("./examples/kernel2.cl");
 
+    const int   width     = src.width;
+    const int   height    = src.height;
+    std::size_t gray_id   = pc.create_kernel ("rgb_to_gray");
     std::size_t kernel_id = pc.create_kernel ("gaussian_blur");
 
-    // Convolution
-    auto  t0         = std::chrono::high_resolution_clock::now();
-    Image convoluted = image_convoluted_parallel (gray, pc, kernel_id);
-    auto  t1         = std::chrono::high_resolution_clock::now();
-    auto  time_elapsed_msec =
-        static_cast<int> (duration_cast<std::chrono::milliseconds> (t1 - t0).count());
+    for (std::size_t id : {gray_id, kernel_id}) {
+        pc.set_kernel_argument (id, 2, sizeof (int), &width);
+        pc.set_kernel_argument (id, 3, sizeof (int), &height);
+    }
+
+    mpoi_chain chain (pc);
+    chain.add_stage (gray_id, width * height * sizeof (uint8_t), 200, width, height)
+        .add_stage (kernel_id, width * height * sizeof (uint8_t), 200, width, height);
+
+    // Gray conversion and convolution
+    auto t0    = std::chrono::high_resolution_clock::now();
+    convoluted = image_convoluted_parallel (src, pc, chain);
+    auto t1    = std::chrono::high_resolution_clock::now();
+    auto time_elapsed_usec =
+        static_cast<int> (duration_cast<std::chrono::microseconds> (t1 - t0).count());
 
     write_pgm_binary (
         filepath.parent_path() / std::filesystem::path{filepath.stem().string() + "_blurred_p.pgm"},
         convoluted
     );
 
-    return time_elapsed_msec;
+    return time_elapsed_usec;
 }
 
 int
 main (int argc, char* argv[]) {
-    const int time_serial = convolution_serial ("examples/lenna.ppm", true);
-    std::cout << std::format ("Running time for serial computation = {} msec\n", time_serial);
+    Image host_result;
+    Image parallel_result;
 
-    const int time_parallel = convolution_parallel ("examples/lenna.ppm");
-    std::cout << std::format ("Running time for parallel computation = {} msec\n", time_parallel);
+    const int time_host = convolution_host ("examples/lenna.ppm", host_result, true);
+    std::cout << std::format ("Running time for host computation = {} usec\n", time_host);
+
+    const int time_parallel = convolution_parallel ("examples/lenna.ppm", parallel_result);
+    std::cout << std::format ("Running time for parallel computation = {} usec\n", time_parallel);
+
+    const auto mismatches = std::ranges::count_if (
+        std::views::iota (std::size_t (0), host_result.pixels.size()),
+        [&] (std::size_t i) { return host_result.pixels[i] != parallel_result.pixels[i]; }
+    );
+    std::cout << std::format ("Pixels differing between host and parallel = {}\n", mismatches);
 }
@@ -0,0 +1,197 @@
+#include "core/mpoi.h"
+#include "core/mpoi_batch.h"
+
+#include <chrono>
+#include <cmath>
+#include <format>
+#include <iostream>
+#include <random>
+#include <ranges>
+#include <vector>
+
+using namespace std::chrono;
+
+template <typename T>
+int
+sgn (T val) {
+    return (T (0) < val) - (val < T (0));
+}
+
+int
+main (int argc, char* argv[]) {
+    mpoi pc ("./examples/kernel1.cl");
+
+    std::size_t kernel_id         = pc.create_kernel ("vec_calc");
+    std::size_t batched_kernel_id = pc.create_kernel ("vec_calc_batched");
+    std::size_t blend_kernel_id   = pc.create_kernel ("vec_blend_batched");
+
+    // Hundreds of tiny problems of different sizes
+    constexpr int                      count_problems = 500;
+    std::mt19937                       gen (0);
+    std::uniform_int_distribution<int> dist (16, 4096);
+
+    std::vector<std::vector<float>> as (count_problems);
+    std::vector<std::vector<float>> bs (count_problems);
+    for (std::size_t p : std::views::iota (0, count_problems)) {
+        const int n = dist (gen);
+        as[p].resize (n);
+        bs[p].resize (n);
+        for (std::size_t i : std::views::iota (0, n)) {
+            as[p][i] = float (i + p);
+            bs[p][i] = float (n - i);
+        }
+    }
+
+    // Keep console output out of the timed regions
+    pc.set_verbose (false);
+
+    // One launch per problem
+    std::vector<std::vector<float>> cs (count_problems);
+
+    auto t0 = high_resolution_clock::now();
+    for (std::size_t p : std::views::iota (0, count_problems)) {
+        const std::size_t size = as[p].size();
+        cs[p].resize (size);
+
+        std::size_t a_buffer =
+            pc.create_buffer (mpoi::buffer_property::READ_ONLY, size * sizeof (float));
+        std::size_t b_buffer =
+            pc.create_buffer (mpoi::buffer_property::READ_ONLY, size * sizeof (float));
+        std::size_t c_buffer =
+            pc.create_buffer (mpoi::buffer_property::READ_WRITE, size * sizeof (float));
+
+        pc.enqueue_write_buffer (a_buffer, size * sizeof (float), as[p].data());
+        pc.enqueue_write_buffer (b_buffer, size * sizeof (float), bs[p].data());
+
+        pc.set_kernel_argument (kernel_id, 0, a_buffer);
+        pc.set_kernel_argument (kernel_id, 1, b_buffer);
+        pc.set_kernel_argument (kernel_id, 2, c_buffer);
+
+        pc.enqueue_data_parallel_kernel (kernel_id, 200, size);
+
+        pc.enqueue_read_buffer (c_buffer, size * sizeof (float), cs[p].data());
+
+        pc.release_buffer (a_buffer);
+        pc.release_buffer (b_buffer);
+        pc.release_buffer (c_buffer);
+    }
+    auto t1                 = high_resolution_clock::now();
+    auto duration_unbatched = duration_cast<microseconds> (t1 - t0).count();
+
+    // A single launch over the whole batch
+    std::vector<std::vector<float>> ds (count_problems);
+
+    t0 = high_resolution_clock::now();
+
+    mpoi_batch<float> a_batch;
+    mpoi_batch<float> b_batch;
+    for (std::size_t p : std::views::iota (0, count_problems)) {
+        a_batch.add (as[p]);
+        b_batch.add (bs[p]);
+    }
+    auto c_batch = mpoi_batch<float>::like (a_batch);
+
+    std::size_t a_buffer = pc.create_buffer (mpoi::buffer_property::READ_ONLY, a_batch.bytes());
+    std::size_t b_buffer = pc.create_buffer (mpoi::buffer_property::READ_ONLY, b_batch.bytes());
+    std::size_t c_buffer = pc.create_buffer (mpoi::buffer_property::READ_WRITE, c_batch.bytes());
+    std::size_t offsets_buffer = pc.create_batch_offsets (a_batch.offsets());
+
+    pc.enqueue_write_buffer (a_buffer, a_batch.bytes(), a_batch.data());
+    pc.enqueue_write_buffer (b_buffer, b_batch.bytes(), b_batch.data());
+
+    pc.set_kernel_argument (batched_kernel_id, 0, a_buffer);
+    pc.set_kernel_argument (batched_kernel_id, 1, b_buffer);
+    pc.set_kernel_argument (batched_kernel_id, 2, c_buffer);
+
+    pc.enqueue_batched_kernel (batched_kernel_id, 3, offsets_buffer, 200);
+
+    pc.enqueue_read_buffer (c_buffer, c_batch.bytes(), c_batch.data());
+
+    pc.release_buffer (a_buffer);
+    pc.release_buffer (b_buffer);
+    pc.release_buffer (c_buffer);
+    pc.release_buffer (offsets_buffer);
+
+    for (std::size_t p : std::views::iota (0, count_problems)) {
+        c_batch.scatter (p, ds[p]);
+    }
+
+    t1                    = high_resolution_clock::now();
+    auto duration_batched = duration_cast<microseconds> (t1 - t0).count();
+
+    // A single launch of a kernel which depends on the problem of each item
+    std::vector<std::vector<float>> es (count_problems);
+
+    t0 = high_resolution_clock::now();
+
+    auto e_batch = mpoi_batch<float>::like (a_batch);
+
+    a_buffer       = pc.create_buffer (mpoi::buffer_property::READ_ONLY, a_batch.bytes());
+    b_buffer       = pc.create_buffer (mpoi::buffer_property::READ_ONLY, b_batch.bytes());
+    c_buffer       = pc.create_buffer (mpoi::buffer_property::READ_WRITE, e_batch.bytes());
+    offsets_buffer = pc.create_batch_offsets (a_batch.offsets());
+
+    pc.enqueue_write_buffer (a_buffer, a_batch.bytes(), a_batch.data());
+    pc.enqueue_write_buffer (b_buffer, b_batch.bytes(), b_batch.data());
+
+    pc.set_kernel_argument (blend_kernel_id, 0, a_buffer);
+    pc.set_kernel_argument (blend_kernel_id, 1, b_buffer);
+    pc.set_kernel_argument (blend_kernel_id, 2, c_buffer);
+
+    pc.enqueue_batched_kernel (blend_kernel_id, 3, offsets_buffer, 200);
+
+    pc.enqueue_read_buffer (c_buffer, e_batch.bytes(), e_batch.data());
+
+    pc.release_buffer (a_buffer);
+    pc.release_buffer (b_buffer);
+    pc.release_buffer (c_buffer);
+    pc.release_buffer (offsets_buffer);
+
+    for (std::size_t p : std::views::iota (0, count_problems)) {
+        e_batch.scatter (p, es[p]);
+    }
+
+    t1                  = high_resolution_clock::now();
+    auto duration_blend = duration_cast<microseconds> (t1 - t0).count();
+
+    // Compare both against the serial computation
+    float diff_unbatched = 0.f;
+    float diff_batched   = 0.f;
+    float diff_blend     = 0.f;
+    for (std::size_t p : std::views::iota (0, count_problems)) {
+        const std::size_t n = as[p].size();
+        for (std::size_t i : std::views::iota (std::size_t (0), n)) {
+            const float term = sin (as[p][i]) * cos (bs[p][i]);
+            const float e    = exp (term + sgn (term) * cos (as[p][i]) * sin (bs[p][i]));
+            diff_unbatched += pow (cs[p][i] - e, 2);
+            diff_batched += pow (ds[p][i] - e, 2);
+
+            const float t = n > 1 ? float (i) / float (n - 1) : 0.f;
+            diff_blend += pow (es[p][i] - (as[p][i] + (bs[p][i] - as[p][i]) * t), 2);
+        }
+    }
+    diff_unbatched /= float (a_batch.size());
+    diff_batched /= float (a_batch.size());
+    diff_blend /= float (a_batch.size());
+
+    std::cout << std::format ("\n\n{0:=^80}\n", " S U M M A R Y ");
+    std::cout << std::format (
+        "{0:^20}{1:^20}{2:^20}{3:^20}\n", "", "Time (usec)", "Launches", "Difference"
+    );
+    std::cout << std::format ("{0:-^80}\n", "");
+    std::cout << std::format (
+        "{0:^20}{1:^20}{2:^20}{3:^20}\n",
+        "Unbatched",
+        duration_unbatched,
+        count_problems,
+        diff_unbatched
+    );
+    std::cout << std::format (
+        "{0:^20}{1:^20}{2:^20}{3:^20}\n", "Batched", duration_batched, 1, diff_batched
+    );
+    std::cout << std::format (
+        "{0:^20}{1:^20}{2:^20}{3:^20}\n", "Batched (blend)", duration_blend, 1, diff_blend
+    );
+
+    return 0;
+}
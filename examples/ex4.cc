@@ -0,0 +1,86 @@
+#include "core/mpoi.h"
+#include "core/mpoi_expr.h"
+
+#include <chrono>
+#include <cmath>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <ranges>
+
+using namespace std::chrono;
+
+int
+main (int argc, char* argv[]) {
+    mpoi pc ("./examples/kernel1.cl");
+
+    std::size_t kernel_id = pc.create_kernel ("vec_calc");
+
+    constexpr int size = 16'000'000;
+
+    auto a = std::make_unique<float[]> (size);
+    auto b = std::make_unique<float[]> (size);
+    auto c = std::make_unique<float[]> (size);
+    auto d = std::make_unique<float[]> (size);
+
+    for (std::size_t i : std::views::iota (0, size)) {
+        a[i] = i;
+        b[i] = size - i;
+    }
+
+    std::size_t a_buffer =
+        pc.create_buffer (mpoi::buffer_property::READ_ONLY, size * sizeof (float));
+    std::size_t b_buffer =
+        pc.create_buffer (mpoi::buffer_property::READ_ONLY, size * sizeof (float));
+    std::size_t c_buffer =
+        pc.create_buffer (mpoi::buffer_property::READ_WRITE, size * sizeof (float));
+
+    pc.enqueue_write_buffer (a_buffer, size * sizeof (float), a.get());
+    pc.enqueue_write_buffer (b_buffer, size * sizeof (float), b.get());
+
+    // Hand-written kernel
+    auto t0 = high_resolution_clock::now();
+
+    pc.set_kernel_argument (kernel_id, 0, a_buffer);
+    pc.set_kernel_argument (kernel_id, 1, b_buffer);
+    pc.set_kernel_argument (kernel_id, 2, c_buffer);
+    pc.enqueue_data_parallel_kernel (kernel_id, 200, size);
+    pc.enqueue_read_buffer (c_buffer, size * sizeof (float), c.get());
+
+    auto t1                   = high_resolution_clock::now();
+    auto duration_handwritten = duration_cast<milliseconds> (t1 - t0).count();
+
+    // The same computation written as an expression; the kernel is generated,
+    // compiled on first use and fetched from the cache afterwards.
+    mpoi_expr::device_vector va (a_buffer, size);
+    mpoi_expr::device_vector vb (b_buffer, size);
+    mpoi_expr::device_vector vc (c_buffer, size);
+
+    for (std::size_t trial : std::views::iota (0, 2)) {
+        t0 = high_resolution_clock::now();
+
+        auto term = sin (va) * cos (vb);
+        mpoi_expr::evaluate (pc, vc, exp (term + sign (term) * cos (va) * sin (vb)), 200);
+        pc.enqueue_read_buffer (c_buffer, size * sizeof (float), d.get());
+
+        t1 = high_resolution_clock::now();
+        std::cout << std::format (
+            "Fused expression ({}): {} msec\n",
+            trial == 0 ? "compiled" : "cached",
+            duration_cast<milliseconds> (t1 - t0).count()
+        );
+    }
+    std::cout << std::format ("Hand-written kernel: {} msec\n", duration_handwritten);
+
+    float diff = 0.f;
+    for (std::size_t j : std::views::iota (0, size)) {
+        diff += pow (c[j] - d[j], 2);
+    }
+    std::cout << std::format ("Difference = {}\n", diff / float (size));
+
+    pc.release_buffer (a_buffer);
+    pc.release_buffer (b_buffer);
+    pc.release_buffer (c_buffer);
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include "core/mpoi.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <ranges>
+
+using namespace std::chrono;
+
+int
+main (int argc, char* argv[]) {
+    mpoi pc ("./examples/kernel1.cl");
+
+    std::size_t kernel_id = pc.create_kernel ("vec_calc");
+
+    constexpr int size = 64'000'000;
+
+    // Quantized sensor readings in [0, 10) with a resolution of 0.125
+    auto a = std::make_unique<float[]> (size);
+    auto b = std::make_unique<float[]> (size);
+    auto c = std::make_unique<float[]> (size);
+    auto d = std::make_unique<float[]> (size);
+
+    for (std::size_t i : std::views::iota (0, size)) {
+        a[i] = float (i % 80) * 0.125f;
+        b[i] = 10.f - float (i % 77) * 0.125f;
+    }
+
+    struct transfer_format {
+        const char*          name;
+        mpoi::storage_format storage;
+        std::size_t          bytes;
+    };
+    const transfer_format formats[] = {
+        {"float32", mpoi::storage_format::FLOAT32, 4},
+        {"float16", mpoi::storage_format::FLOAT16, 2},
+        {"bfloat16", mpoi::storage_format::BFLOAT16, 2},
+        {"int8", mpoi::storage_format::INT8, 1},
+    };
+
+    // int8: x = q / 8 + 5, so that 0.125 steps in [-11, 20.875] are exact
+    const float scale  = 0.125f;
+    const float offset = 5.f;
+
+    // Keep console output out of the timed regions
+    pc.set_verbose (false);
+
+    constexpr int count_trials = 10;
+
+    std::cout << std::format ("\n\n{0:=^80}\n", " S U M M A R Y ");
+    std::cout << std::format (
+        "{0:^20}{1:^20}{2:^20}{3:^20}\n",
+        "Format",
+        "Avg. time (msec)",
+        "Bytes moved",
+        "Max. difference"
+    );
+    std::cout << std::format ("{0:-^80}\n", "");
+
+    for (const transfer_format& f : formats) {
+        // The conversion kernels of a format are compiled on its first typed
+        // transfer, which must not be timed.
+        std::size_t warm_up = pc.create_typed_buffer (f.storage, 1024, scale, offset);
+        pc.enqueue_write_typed_buffer (warm_up, 1024, a.get());
+        pc.release_buffer (warm_up);
+
+        int   sum_duration = 0;
+        float max_diff     = 0.f;
+        for (std::size_t i : std::views::iota (0, count_trials)) {
+            auto t0 = high_resolution_clock::now();
+
+            std::size_t a_buffer = pc.create_typed_buffer (f.storage, size, scale, offset);
+            std::size_t b_buffer = pc.create_typed_buffer (f.storage, size, scale, offset);
+            std::size_t c_buffer =
+                pc.create_buffer (mpoi::buffer_property::READ_WRITE, size * sizeof (float));
+
+            pc.enqueue_write_typed_buffer (a_buffer, size, a.get());
+            pc.enqueue_write_typed_buffer (b_buffer, size, b.get());
+
+            pc.set_kernel_argument (kernel_id, 0, a_buffer);
+            pc.set_kernel_argument (kernel_id, 1, b_buffer);
+            pc.set_kernel_argument (kernel_id, 2, c_buffer);
+
+            pc.enqueue_data_parallel_kernel (kernel_id, 200, size);
+
+            pc.enqueue_read_buffer (c_buffer, size * sizeof (float), d.get());
+
+            pc.release_buffer (a_buffer);
+            pc.release_buffer (b_buffer);
+            pc.release_buffer (c_buffer);
+
+            auto t1 = high_resolution_clock::now();
+            sum_duration += static_cast<int> (duration_cast<milliseconds> (t1 - t0).count());
+
+            if (f.storage == mpoi::storage_format::FLOAT32 && i == 0) {
+                std::copy (d.get(), d.get() + size, c.get());
+            }
+            for (std::size_t j : std::views::iota (0, size)) {
+                max_diff = std::max (max_diff, std::fabs (c[j] - d[j]));
+            }
+        }
+
+        std::cout << std::format (
+            "{0:^20}{1:^20}{2:^20}{3:^20}\n",
+            f.name,
+            float (sum_duration) / float (count_trials),
+            2 * size * f.bytes + size * sizeof (float),
+            max_diff
+        );
+    }
+
+    return 0;
+}
@@ -1,9 +1,49 @@
+inline float vec_calc_element (const float a, const float b) {
+    float term = sin(a)*cos(b);
+    return exp(term + sign(term)*cos(a)*sin(b));
+}
+
 __kernel void vec_calc (global const float* a,
                         global const float* b,
                         global float* result
                         ) {
     int id = get_global_id(0);
 
-    float term = sin(a[id])*cos(b[id]);
-    result[id] = exp(term + sign(term)*cos(a[id])*sin(b[id]));
+    result[id] = vec_calc_element(a[id], b[id]);
+}
+
+// Same computation over a batch of independent problems packed back to back
+// (see mpoi_batch). Element-wise kernels only need the bounds check; kernels
+// that depend on the problem can use mpoi_batch_problem() and friends.
+__kernel void vec_calc_batched (global const float* a,
+                                global const float* b,
+                                global float* result,
+                                global const uint* offsets,
+                                const uint count
+                                ) {
+    uint id = get_global_id(0);
+    if (id >= mpoi_batch_total_size(offsets, count))
+        return;
+
+    result[id] = vec_calc_element(a[id], b[id]);
+}
+
+// Cross-fades from a to b over each problem of the batch, which needs the
+// position of the work item inside its problem and the size of that problem.
+__kernel void vec_blend_batched (global const float* a,
+                                 global const float* b,
+                                 global float* result,
+                                 global const uint* offsets,
+                                 const uint count
+                                 ) {
+    uint id = get_global_id(0);
+    if (id >= mpoi_batch_total_size(offsets, count))
+        return;
+
+    const uint problem = mpoi_batch_problem(offsets, count, id);
+    const uint size    = mpoi_batch_problem_size(offsets, problem);
+    const uint i       = mpoi_batch_local_id(offsets, problem, id);
+
+    const float t = size > 1 ? (float)i / (float)(size - 1) : 0.f;
+    result[id] = mix(a[id], b[id], t);
 }
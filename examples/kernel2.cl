@@ -1,3 +1,24 @@
+// Fixed-point weights (0.299, 0.587, 0.114) * 256, identical to the host conversion
+__kernel void rgb_to_gray (
+    __global const uchar* input,  // input image (RGB triplets)
+    __global uchar* output,       // output image (grayscale)
+    const int w,                  // image width
+    const int h                   // image height
+) {
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+
+    if (x >= w || y >= h)
+        return;
+
+    int i = y * w + x;
+    uint r = input[3 * i];
+    uint g = input[3 * i + 1];
+    uint b = input[3 * i + 2];
+
+    output[i] = (uchar)((77 * r + 150 * g + 29 * b) >> 8);
+}
+
 __constant float gaussian[9] = { 1, 8, 28, 56, 70, 56, 28, 8, 1 };
 
 __kernel void gaussian_blur (